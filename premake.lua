@@ -114,7 +114,7 @@ project "fbx-conv"
 	--- LINUX ----------------------------------------------------------
 	configuration { "linux" }
 		kind "ConsoleApp"
-		buildoptions { "-Wall" }
+		buildoptions { "-Wall", "-std=c++11" }
 		-- TODO: while using x64 will likely be fine for most people nowadays,
 		--       we still need to make this configurable
 		libdirs {
@@ -142,7 +142,7 @@ project "fbx-conv"
 	--- MAC ------------------------------------------------------------
 	configuration { "macosx" }
 		kind "ConsoleApp"
-		buildoptions { "-Wall" }
+		buildoptions { "-Wall", "-std=c++11" }
 		
 		xcodebuildsettings {
 			["ALWAYS_SEARCH_USER_PATHS"] = "YES"
@@ -170,9 +170,55 @@ class FbxConv {
 			log->status(log::sExportClose);
 			myfile.close();
 
+			return saveChunks(settings, model) && result;
+		}
+
+		/** Write the chunks of each chunked animation to its own file: the magic "G3DC", the number of chunks and a seek table with the
+		 * start time, end time, offset and size of each chunk, followed by the chunks as UBJSON. The values are big endian, like UBJSON. */
+		bool saveChunks(Settings * const &settings, modeldata::Model *model) {
+			bool result = true;
+			for (std::vector<modeldata::Animation *>::const_iterator itr = model->animations.begin(); itr != model->animations.end(); ++itr) {
+				const std::vector<modeldata::Animation *> &chunks = (*itr)->chunks;
+				if (chunks.empty())
+					continue;
+				const std::string path = readers::getDirectory(settings->outFile) + (*itr)->chunkFile;
+				log->status(log::sExportChunks, path.c_str());
+				std::vector<std::string> data(chunks.size());
+				for (size_t i = 0; i < chunks.size(); i++) {
+					std::stringstream stream;
+					{
+						json::UBJSONWriter writer(stream);
+						writer << chunks[i];
+					}
+					data[i] = stream.str();
+				}
+
+				std::ofstream file(path.c_str(), std::ios::binary);
+				if (!file) {
+					log->error(log::eExportChunks, path.c_str());
+					result = false;
+					continue;
+				}
+				file.write("G3DC", 4);
+				writeBigEndian(file, (unsigned int)chunks.size());
+				unsigned int offset = 8 + 16 * (unsigned int)chunks.size();
+				for (size_t i = 0; i < chunks.size(); i++) {
+					writeBigEndian(file, (float)i * (*itr)->chunkDuration);
+					writeBigEndian(file, readers::FbxAnimation::getDuration(chunks[i]));
+					writeBigEndian(file, offset);
+					writeBigEndian(file, (unsigned int)data[i].size());
+					offset += (unsigned int)data[i].size();
+				}
+				for (size_t i = 0; i < chunks.size(); i++)
+					file.write(data[i].data(), data[i].size());
+			}
 			return result;
 		}
 
+		template<typename T> static void writeBigEndian(std::ostream &stream, const T &value) {
+			stream.write(json::is_bigendian ? (const char *)&value : json::swap(value), sizeof(T));
+		}
+
 		void info(modeldata::Model *model) {
 			if (!model)
 				log->verbose(log::iModelInfoNull);
@@ -40,6 +40,22 @@ struct FbxConvCommand {
 		settings->flipV = false;
 		settings->packColors = false;
 		settings->verbose = false;
+		settings->spatialSort = false;
+		settings->buildClusters = false;
+		settings->forceFpsSamplesAnimations = false;
+		settings->animationPositionTolerance = 0.0001f;
+		settings->animationRotationTolerance = 0.01f;
+		settings->animationScaleTolerance = 0.0001f;
+		settings->quantizeAnimations = false;
+		settings->cubicAnimations = false;
+		settings->fixedAnimationRate = 0.f;
+		settings->animationChunkDuration = 0.f;
+		settings->animationThreads = 1;
+		settings->morphTargets = false;
+		settings->vertexAnimationsRGBA8 = false;
+		settings->inverseBindMatrices = false;
+		settings->pruneNodes = false;
+		settings->animationsOnly = false;
 		settings->maxNodePartBonesCount = 12;
 		settings->maxVertexBonesCount = 4;
 		settings->maxVertexCount = (1<<15)-1;
@@ -51,7 +67,9 @@ struct FbxConvCommand {
 			const char *arg = argv[i];
 			const int len = (int)strlen(arg);
 			if (len > 1 && arg[0] == '-') {
-				if (arg[1] == '?')
+				if (strcmp(arg, "--animations-only") == 0)
+					settings->animationsOnly = true;
+				else if (arg[1] == '?')
 					help = true;
 				else if (arg[1] == 'f')
 					settings->flipV = true;
@@ -59,6 +77,28 @@ struct FbxConvCommand {
 					settings->verbose = true;
 				else if (arg[1] == 'p')
 					settings->packColors = true;
+				else if (arg[1] == 'z')
+					settings->spatialSort = true;
+				else if (arg[1] == 'c')
+					settings->buildClusters = true;
+				else if (arg[1] == 's')
+					settings->forceFpsSamplesAnimations = true;
+				else if (arg[1] == 'q')
+					settings->quantizeAnimations = true;
+				else if (arg[1] == 'k')
+					settings->cubicAnimations = true;
+				else if (arg[1] == 'd')
+					settings->morphTargets = true;
+				else if (arg[1] == 'l')
+					settings->vertexAnimationsRGBA8 = true;
+				else if (arg[1] == 'I')
+					settings->inverseBindMatrices = true;
+				else if (arg[1] == 'x')
+					settings->pruneNodes = true;
+				else if ((arg[1] == 'n') && (i + 1 < argc))
+					parseIds(argv[++i], settings->keepNodes);
+				else if ((arg[1] == 'a') && (i + 1 < argc))
+					parseIds(argv[++i], settings->vertexAnimations);
 				else if ((arg[1] == 'i') && (i + 1 < argc))
 					settings->inType = parseType(argv[++i]);
 				else if ((arg[1] == 'o') && (i + 1 < argc))
@@ -69,6 +109,14 @@ struct FbxConvCommand {
 					settings->maxVertexBonesCount = atoi(argv[++i]);
 				else if ((arg[1] == 'm') && (i + 1 < argc))
 					settings->maxVertexCount = settings->maxIndexCount = atoi(argv[++i]);
+				else if ((arg[1] == 'e') && (i + 1 < argc))
+					parseTolerances(argv[++i]);
+				else if ((arg[1] == 'r') && (i + 1 < argc))
+					settings->fixedAnimationRate = (float)atof(argv[++i]);
+				else if ((arg[1] == 't') && (i + 1 < argc))
+					settings->animationChunkDuration = (float)atof(argv[++i]);
+				else if ((arg[1] == 'j') && (i + 1 < argc))
+					settings->animationThreads = atoi(argv[++i]);
 				else
 					log->error(error = log::eCommandLineUnknownOption, arg);
 			}
@@ -108,6 +156,22 @@ struct FbxConvCommand {
 		printf("-m <size>: The maximum amount of vertices or indices a mesh may contain (default: 32k)\n");
 		printf("-b <size>: The maximum amount of bones a nodepart can contain (default: 12)\n");
 		printf("-w <size>: The maximum amount of bone weights per vertex (default: 4)\n");
+		printf("-z       : Sort the triangles spatially and optimize them for the vertex cache.\n");
+		printf("-c       : Split the meshparts in clusters of at most 64 vertices and 124 triangles.\n");
+		printf("-s       : Sample the animations at the frame rate instead of using the actual keys.\n");
+		printf("-e <p,r,s>: The maximum animation error in position units, rotation degrees and scale ratio (default: 0.0001,0.01,0.0001)\n");
+		printf("-q       : Quantize the animation keyframes (16 bit frames, values and 48 bit rotations).\n");
+		printf("-k       : Fit the animations with cubic segments, storing the in and out tangent of each keyframe (overrides -q).\n");
+		printf("-d       : Export the blend shapes as sparse morph targets, along with their weight animations.\n");
+		printf("-a <ids> : Comma separated ids of the animations to bake into a vertex animation texture per mesh.\n");
+		printf("-l       : Store the vertex animation textures as RGBA8 instead of half floats.\n");
+		printf("-I       : Write the inverse bind matrix (4x4 floats) of each bone instead of its bind pose.\n");
+		printf("-x       : Remove the nodes and animations which don't affect any rendered geometry.\n");
+		printf("-n <ids> : Comma separated ids of the nodes to keep when using -x.\n");
+		printf("-r <fps> : Resample the animations at a fixed rate and store them as dense frames (overrides -q).\n");
+		printf("-t <sec> : Split the animations in chunks of this duration, written to a separate file per animation (overrides -r).\n");
+		printf("-j <size>: The number of threads used to convert the animations (0 for all cores, default: 1)\n");
+		printf("--animations-only: Only convert the node ids and the animations, to be used along with a model containing the meshes.\n");
 		printf("-v       : Verbose: print additional progress information\n");
 		printf("\n");
 		printf("<input>  : The filename of the file to convert.\n");
@@ -145,6 +209,35 @@ private:
 			log->error(error = log::eCommandLineInvalidVertexCount);
 			return;
 		}
+		if (settings->cubicAnimations && settings->quantizeAnimations) {
+			log->warning(log::wCommandLineCubicQuantized);
+			settings->quantizeAnimations = false;
+		}
+		// The fixed rate is still used to bake the vertex animations (-a)
+		if (settings->animationChunkDuration > 0.f && settings->fixedAnimationRate > 0.f)
+			log->warning(log::wCommandLineChunksFixedRate);
+	}
+
+	void parseTolerances(const char* arg) {
+		float p, r, s;
+		if (sscanf(arg, "%f,%f,%f", &p, &r, &s) != 3 || p <= 0.f || r <= 0.f || s <= 0.f) {
+			log->error(error = log::eCommandLineInvalidTolerance, arg);
+			return;
+		}
+		settings->animationPositionTolerance = p;
+		settings->animationRotationTolerance = r;
+		settings->animationScaleTolerance = s;
+	}
+
+	void parseIds(const char* arg, std::vector<std::string> &out) {
+		std::string ids(arg);
+		for (size_t start = 0, end; start <= ids.length(); start = end + 1) {
+			end = ids.find(',', start);
+			if (end == std::string::npos)
+				end = ids.length();
+			if (end > start)
+				out.push_back(ids.substr(start, end - start));
+		}
 	}
 
 	int parseType(const char* arg, const int &def = -1) {
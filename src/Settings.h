@@ -21,6 +21,7 @@
 #define SETTINGS_H
 
 #include <string>
+#include <vector>
 
 namespace fbxconv {
 
@@ -51,6 +52,40 @@ struct Settings {
 	int maxVertexCount;
 	/** The maximum allowed amount of indices in one mesh, only used when deciding to merge meshes. */
 	int maxIndexCount;
+	/** Whether to sort the triangles of each meshpart spatially (morton order) and optimize them for the vertex cache. */
+	bool spatialSort;
+	/** Whether to split each meshpart in clusters with a bounding sphere and normal cone for culling. */
+	bool buildClusters;
+	/** Whether to always sample the animations at the frame rate, instead of using the actual keys. */
+	bool forceFpsSamplesAnimations;
+	/** The maximum error allowed when removing animation keyframes: in position units, rotation degrees and scale ratio. */
+	float animationPositionTolerance;
+	float animationRotationTolerance;
+	float animationScaleTolerance;
+	/** Whether to write the animations in quantized (compressed) form. */
+	bool quantizeAnimations;
+	/** Whether to fit the animation tracks with cubic (hermite) segments, storing the tangents of each keyframe. */
+	bool cubicAnimations;
+	/** If more than zero, the animations are resampled at this rate (frames per second) and stored as dense frames. */
+	float fixedAnimationRate;
+	/** If more than zero, the animations are split in chunks of this duration (seconds), written to a separate file per animation. */
+	float animationChunkDuration;
+	/** The number of threads used to convert the animations, zero to use all cores (default one). */
+	unsigned int animationThreads;
+	/** Whether to export the blend shapes as sparse morph targets, along with their weight animations. */
+	bool morphTargets;
+	/** The ids of the animation stacks of which the vertex positions and normals are baked into a texture per mesh. */
+	std::vector<std::string> vertexAnimations;
+	/** Whether to store the baked vertex animations as RGBA8 instead of half floats. */
+	bool vertexAnimationsRGBA8;
+	/** Whether to write the inverse bind matrix of each bone instead of its decomposed bind pose. */
+	bool inverseBindMatrices;
+	/** Whether to remove the nodes (and their animations) which don't affect any rendered geometry. */
+	bool pruneNodes;
+	/** The ids of the nodes which are never removed when pruning. */
+	std::vector<std::string> keepNodes;
+	/** Whether to only convert the node hierarchy and the animations, skipping the meshes, materials and textures. */
+	bool animationsOnly;
 };
 
 }
@@ -38,6 +38,9 @@ LOG_ADD_CODE(eCommandLineInvalidVertexWeight)
 LOG_ADD_CODE(eCommandLineInvalidBoneCount)
 LOG_ADD_CODE(eCommandLineInvalidVertexCount)
 LOG_ADD_CODE(eCommandLineUnknownFiletype)
+LOG_ADD_CODE(eCommandLineInvalidTolerance)
+LOG_ADD_CODE(wCommandLineCubicQuantized)
+LOG_ADD_CODE(wCommandLineChunksFixedRate)
 
 LOG_ADD_CODE(sSourceLoad)
 LOG_ADD_CODE(sSourceLoadFbxVersion)
@@ -70,6 +73,19 @@ LOG_ADD_CODE(wSourceConvertFbxMaterialCgFX)
 LOG_ADD_CODE(wSourceConvertFbxLayeredTexture)
 LOG_ADD_CODE(wSourceConvertFbxSkipPropname)
 LOG_ADD_CODE(wSourceConvertFbxInvalidMesh)
+LOG_ADD_CODE(iSourceConvertFbxLayeredAnimation)
+LOG_ADD_CODE(iSourceConvertFbxUnsupportedInterpolation)
+LOG_ADD_CODE(iSourceConvertFbxAnimationTime)
+LOG_ADD_CODE(iSourceConvertFbxAnimationThreads)
+LOG_ADD_CODE(wSourceConvertFbxAnimationSceneCopy)
+LOG_ADD_CODE(iSourceConvertFbxQuantizedAnimation)
+LOG_ADD_CODE(iSourceConvertFbxAnimationChunks)
+LOG_ADD_CODE(iSourceConvertFbxPrunedNodes)
+LOG_ADD_CODE(iSourceConvertFbxMorphTargets)
+LOG_ADD_CODE(iSourceConvertFbxVertexAnimation)
+LOG_ADD_CODE(wSourceConvertFbxVertexAnimationStack)
+LOG_ADD_CODE(wSourceConvertFbxVertexAnimationUV)
+LOG_ADD_CODE(wSourceConvertFbxVertexAnimationWrite)
 LOG_ADD_CODE(eSourceConvert)
 
 LOG_ADD_CODE(sSourceClose)
@@ -79,6 +95,8 @@ LOG_ADD_CODE(sExportToG3DB)
 LOG_ADD_CODE(sExportToG3DJ)
 LOG_ADD_CODE(sExportClose)
 LOG_ADD_CODE(eExportFiletypeUnknown)
+LOG_ADD_CODE(sExportChunks)
+LOG_ADD_CODE(eExportChunks)
 
 LOG_ADD_CODE(iModelInfoNull)
 LOG_ADD_CODE(iModelInfoStart)
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <cassert>
+#include <mutex>
 #include "codes.h"
 
 namespace fbxconv {
@@ -48,6 +49,8 @@ namespace log {
 
 		int filter;
 		LogMessages * messages;
+		// Serializes the messages, which are formatted in a shared buffer
+		std::mutex mutex;
 
 		Log(LogMessages * const &messages, const int &filter = -1) : messages(messages), filter(filter) {}
 
@@ -113,10 +116,12 @@ namespace log {
 		}
 
 		virtual void vlog(const int &type, const int &code, va_list vl) {
+			std::lock_guard<std::mutex> lock(mutex);
 			log(type, vformat(code, vl));
 		}
 
 		virtual void vlog(const int &type, const char *m, va_list vl) {
+			std::lock_guard<std::mutex> lock(mutex);
 			log(type, vformat(m, vl));
 		}
 
@@ -39,6 +39,9 @@ LOG_SET_MSG(eCommandLineInvalidVertexWeight,	"Maximum vertex weights must be bet
 LOG_SET_MSG(eCommandLineInvalidBoneCount,		"Maximum bones per nodepart must be greater or equal to the maximum vertex weights")
 LOG_SET_MSG(eCommandLineInvalidVertexCount,		"Maximum vertex count must be between 0 and 32k")
 LOG_SET_MSG(eCommandLineUnknownFiletype,		"Unknown filetype: %s")
+LOG_SET_MSG(eCommandLineInvalidTolerance,		"Invalid animation tolerances, expected three positive values <position,degrees,scale>: %s")
+LOG_SET_MSG(wCommandLineCubicQuantized,		"Cubic animations (-k) can't be quantized, ignoring -q")
+LOG_SET_MSG(wCommandLineChunksFixedRate,		"Chunked animations (-t) can't be resampled at a fixed rate, ignoring -r for the node animations")
 
 LOG_SET_MSG(sSourceLoad,						"Loading source file")
 LOG_SET_MSG(sSourceLoadFbxVersion,              "FBX file version %d %d %d")
@@ -71,6 +74,19 @@ LOG_SET_MSG(wSourceConvertFbxMaterialCgFX,		"[%s] Material CgFX shading not supp
 LOG_SET_MSG(wSourceConvertFbxLayeredTexture,	"[%s] Layered texture blending not supported, assuming full opacity")
 LOG_SET_MSG(wSourceConvertFbxSkipPropname,		"[%s] Skipping propName '%s'")
 LOG_SET_MSG(wSourceConvertFbxInvalidMesh,		"[%s] Skipping invalid mesh")
+LOG_SET_MSG(iSourceConvertFbxLayeredAnimation,	"[%s] Blending the %d animation layers into a single layer")
+LOG_SET_MSG(iSourceConvertFbxUnsupportedInterpolation,	"[%s] Unsupported interpolation for node '%s', subdividing its segments")
+LOG_SET_MSG(iSourceConvertFbxAnimationTime,		"[%s] Animation converted (%s) in %.1f ms")
+LOG_SET_MSG(iSourceConvertFbxAnimationThreads,	"Converting %d animations using %d threads")
+LOG_SET_MSG(wSourceConvertFbxAnimationSceneCopy,	"The nodes of the scene copy can't be matched to the source (e.g. duplicate node names), converting the animations on a single thread")
+LOG_SET_MSG(iSourceConvertFbxQuantizedAnimation,	"[%s] Animation quantized, maximum error: %f (translation), %f degrees (rotation), %f (scale), %f (weight), %.3f ms (key time, %d keys merged)")
+LOG_SET_MSG(iSourceConvertFbxAnimationChunks,	"[%s] Animation split in %d chunks, written to %s")
+LOG_SET_MSG(iSourceConvertFbxPrunedNodes,		"Removed %d unused nodes and %d node animations")
+LOG_SET_MSG(iSourceConvertFbxMorphTargets,		"[%s] Added %d morph targets with %d vertex deltas in total (mesh has %d vertices)")
+LOG_SET_MSG(iSourceConvertFbxVertexAnimation,	"[%s] Baked %d frames of %d vertices into %s (%dx%d)")
+LOG_SET_MSG(wSourceConvertFbxVertexAnimationStack,	"[%s] Animation not found, skipping the vertex animation")
+LOG_SET_MSG(wSourceConvertFbxVertexAnimationUV,	"Mesh %d has no texture coordinates left for the vertex animation lookup, skipping it")
+LOG_SET_MSG(wSourceConvertFbxVertexAnimationWrite,	"[%s] Could not write the vertex animation texture")
 LOG_SET_MSG(eSourceConvert,						"Error converting source file")
 
 LOG_SET_MSG(sSourceClose,						"Closing source file")
@@ -80,6 +96,8 @@ LOG_SET_MSG(sExportToG3DB,						"Exporting to G3DB file: %s")
 LOG_SET_MSG(sExportToG3DJ,						"Exporting to G3DJ file: %s")
 LOG_SET_MSG(sExportClose,						"Closing exported file")
 LOG_SET_MSG(eExportFiletypeUnknown,				"Unknown target filetype")
+LOG_SET_MSG(sExportChunks,						"Exporting animation chunks to: %s")
+LOG_SET_MSG(eExportChunks,						"Could not write the animation chunks to: %s")
 
 LOG_SET_MSG(iModelInfoNull,						"Model is null")
 LOG_SET_MSG(iModelInfoStart,					"Listing model information:")
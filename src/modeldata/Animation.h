@@ -23,6 +23,7 @@
 #include <vector>
 #include "Node.h"
 #include "NodeAnimation.h"
+#include "FixedRateKeyframes.h"
 #include "../json/BaseJSONWriter.h"
 
 namespace fbxconv {
@@ -32,19 +33,36 @@ namespace modeldata {
 	struct Animation : public json::ConstSerializable {
 		std::string id;
 		std::vector<NodeAnimation *> nodeAnimations;
+		/** If set, the keyframes of all node animations are written in this dense form */
+		FixedRateKeyframes *fixedRate;
+		/** If not empty, the keyframes are split in time windows of chunkDuration milliseconds. Each chunk contains the keys of
+		 * all tracks within its window (including both boundaries) and is written to a separate section of chunkFile,
+		 * instead of the node animations being written with the animation. */
+		std::vector<Animation *> chunks;
+		float chunkDuration;
+		std::string chunkFile;
 
-		Animation() {}
+		Animation() : fixedRate(0), chunkDuration(0.f) {}
 
 		Animation(const Animation &copyFrom) {
 			id = copyFrom.id;
+			fixedRate = copyFrom.fixedRate ? new FixedRateKeyframes(*copyFrom.fixedRate) : 0;
 			for (std::vector<NodeAnimation *>::const_iterator itr = copyFrom.nodeAnimations.begin(); itr != copyFrom.nodeAnimations.end(); ++itr)
 				nodeAnimations.push_back(new NodeAnimation(*(*itr)));
+			for (std::vector<Animation *>::const_iterator itr = copyFrom.chunks.begin(); itr != copyFrom.chunks.end(); ++itr)
+				chunks.push_back(new Animation(*(*itr)));
+			chunkDuration = copyFrom.chunkDuration;
+			chunkFile = copyFrom.chunkFile;
 		}
 
 		~Animation() {
 			for (std::vector<NodeAnimation *>::iterator itr = nodeAnimations.begin(); itr != nodeAnimations.end(); ++itr)
 				if ((*itr)!=0)
 					delete *itr;
+			if (fixedRate)
+				delete fixedRate;
+			for (std::vector<Animation *>::iterator itr = chunks.begin(); itr != chunks.end(); ++itr)
+				delete *itr;
 		}
 
 		virtual void serialize(json::BaseJSONWriter &writer) const;
@@ -120,6 +120,15 @@ namespace modeldata {
 			return result;
 		}
 
+		/** The offset (in number of floats) of the attribute within a vertex, the attribute doesn't have to be present */
+		unsigned int offset(const unsigned int &attribute) const {
+			unsigned int result = 0;
+			for (unsigned int i = 0; i < attribute; i++)
+				if (has(i))
+					result += (unsigned int)ATTRIBUTE_SIZE(i);
+			return result;
+		}
+
 		unsigned int length() const {
 			unsigned int result = 0;
 			for (unsigned int i = 0; i < ATTRIBUTE_COUNT; i++)
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif
+#ifndef MODELDATA_FIXEDRATEKEYFRAMES_H
+#define MODELDATA_FIXEDRATEKEYFRAMES_H
+
+#include <vector>
+#include "../json/BaseJSONWriter.h"
+
+namespace fbxconv {
+namespace modeldata {
+	/** The keyframes of all node animations of an animation, resampled at a fixed rate. The values are stored frame by frame,
+	 * each frame contains frameSize floats: the animated channels of each node animation at the offsets specified by it.
+	 * The value of a channel at frame f is at values[f * frameSize + offset], the time of frame f is f * 1000 / frameRate. */
+	struct FixedRateKeyframes : public json::ConstSerializable {
+		float frameRate;
+		unsigned int frameCount;
+		unsigned int frameSize;
+		std::vector<float> values;
+
+		FixedRateKeyframes() : frameRate(0.f), frameCount(0), frameSize(0) {}
+
+		virtual void serialize(json::BaseJSONWriter &writer) const;
+	};
+} }
+
+#endif //MODELDATA_FIXEDRATEKEYFRAMES_H
@@ -20,36 +20,66 @@
 #ifndef MODELDATA_KEYFRAME_H
 #define MODELDATA_KEYFRAME_H
 
+#include <vector>
 #include "../json/BaseJSONWriter.h"
 
 namespace fbxconv {
 namespace modeldata {
 
-	struct Keyframe : public json::ConstSerializable {
-		float time;
-		float translation[3];
-		float rotation[4];
-		float scale[3];
-		bool hasTranslation;
-		bool hasRotation;
-		bool hasScale;
-
-		Keyframe() {
-			time = 0.;
-			translation[0] = translation[1] = translation[2] = 0.;
-			rotation[0] = rotation[1] = rotation[2] = 0.; rotation[3] = 1.;
-			scale[0] = scale[1] = scale[2] = 1.;
-			hasTranslation = hasRotation = hasScale = false;
-		}
-
-		Keyframe(const Keyframe &rhs) {
-			time = rhs.time;
-			memcpy(translation, rhs.translation, sizeof(translation));
-			memcpy(rotation, rhs.rotation, sizeof(rotation));
-			memcpy(scale, rhs.scale, sizeof(scale));
-			hasTranslation = rhs.hasTranslation;
-			hasRotation = rhs.hasRotation;
-			hasScale = rhs.hasScale;
+	/** A translation (n = 3), rotation (n = 4), scaling (n = 3) or morph target weight (n = 1) track. The keyframes are stored by value,
+	 * the key times and the n values of each key are kept in two contiguous arrays.
+	 * Cubic tracks also have the incoming and outgoing (hermite) tangent of each key, per millisecond. */
+	template<int n> struct Keyframes : public json::ConstSerializable {
+		std::vector<float> times;
+		std::vector<float> values;
+		std::vector<float> inTangents;
+		std::vector<float> outTangents;
+
+		inline size_t size() const {
+			return times.size();
+		}
+
+		inline bool empty() const {
+			return times.empty();
+		}
+
+		inline void reserve(const size_t &count, const bool &cubic = false) {
+			times.reserve(count);
+			values.reserve(count * n);
+			if (cubic) {
+				inTangents.reserve(count * n);
+				outTangents.reserve(count * n);
+			}
+		}
+
+		inline bool cubic() const {
+			return !inTangents.empty();
+		}
+
+		inline void clear() {
+			times.clear();
+			values.clear();
+			inTangents.clear();
+			outTangents.clear();
+		}
+
+		inline void add(const float &time, const float *value) {
+			times.push_back(time);
+			values.insert(values.end(), value, value + n);
+		}
+
+		inline void add(const float &time, const float *value, const float *inTangent, const float *outTangent) {
+			add(time, value);
+			inTangents.insert(inTangents.end(), inTangent, inTangent + n);
+			outTangents.insert(outTangents.end(), outTangent, outTangent + n);
+		}
+
+		inline float *value(const size_t &index) {
+			return &values[index * n];
+		}
+
+		inline const float *value(const size_t &index) const {
+			return &values[index * n];
 		}
 
 		virtual void serialize(json::BaseJSONWriter &writer) const;
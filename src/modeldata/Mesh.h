@@ -22,6 +22,8 @@
 
 #include <vector>
 #include "MeshPart.h"
+#include "MorphTarget.h"
+#include "VertexAnimation.h"
 #include "Attributes.h"
 #include "../json/BaseJSONWriter.h"
 
@@ -39,6 +41,10 @@ namespace modeldata {
 		std::vector<unsigned int> hashes;
 		/** the indexed parts of this mesh */
 		std::vector<MeshPart *> parts;
+		/** the sparse morph targets of this mesh */
+		std::vector<MorphTarget *> targets;
+		/** the baked vertex animations of this mesh */
+		std::vector<VertexAnimation *> vertexAnimations;
 
 		/** ctor */
 		Mesh() : attributes(0), vertexSize(0) {}
@@ -50,6 +56,10 @@ namespace modeldata {
 			vertices.insert(vertices.end(), copyFrom.vertices.begin(), copyFrom.vertices.end());
 			for (std::vector<MeshPart *>::const_iterator itr = copyFrom.parts.begin(); itr != copyFrom.parts.end(); ++itr)
 				parts.push_back(new MeshPart(**itr));
+			for (std::vector<MorphTarget *>::const_iterator itr = copyFrom.targets.begin(); itr != copyFrom.targets.end(); ++itr)
+				targets.push_back(new MorphTarget(**itr));
+			for (std::vector<VertexAnimation *>::const_iterator itr = copyFrom.vertexAnimations.begin(); itr != copyFrom.vertexAnimations.end(); ++itr)
+				vertexAnimations.push_back(new VertexAnimation(**itr));
 		}
 
 		~Mesh() {
@@ -63,6 +73,12 @@ namespace modeldata {
 			for (std::vector<MeshPart *>::iterator itr = parts.begin(); itr != parts.end(); ++itr)
 				delete (*itr);
 			parts.clear();
+			for (std::vector<MorphTarget *>::iterator itr = targets.begin(); itr != targets.end(); ++itr)
+				delete (*itr);
+			targets.clear();
+			for (std::vector<VertexAnimation *>::iterator itr = vertexAnimations.begin(); itr != vertexAnimations.end(); ++itr)
+				delete (*itr);
+			vertexAnimations.clear();
 		}
 
 		inline unsigned int indexCount() {
@@ -33,15 +33,38 @@
 namespace fbxconv {
 namespace modeldata {
 	struct MeshPart : public json::ConstSerializable {
+		/** A consecutive range of triangles of the meshpart, which can be culled as a whole. */
+		struct Cluster : public json::ConstSerializable {
+			/** The first index and the number of indices within the meshpart */
+			unsigned int offset, count;
+			/** The bounding sphere (x, y, z, radius) */
+			float sphere[4];
+			/** The normal cone axis (x, y, z) and cutoff, all triangles are backfacing if
+			 * dot(center - camera, axis) >= cutoff * length(center - camera) + radius. A cutoff of 1 disables the cone,
+			 * which is used when the normals spread (nearly) over a hemisphere: a minimum dot product with the axis of 0.1 or less. */
+			float cone[4];
+
+			Cluster() : offset(0), count(0) {
+				memset(sphere, 0, sizeof(sphere));
+				memset(cone, 0, sizeof(cone));
+				cone[3] = 1.f;
+			}
+
+			virtual void serialize(json::BaseJSONWriter &writer) const;
+		};
+
 		std::string id;
 		std::vector<unsigned short> indices;
 		unsigned int primitiveType;
 		std::vector<FbxCluster *> sourceBones;
+		/** Optional clusters covering all indices, in order */
+		std::vector<Cluster> clusters;
 
 		MeshPart() : primitiveType(0) {}
 
 		MeshPart(const MeshPart &copyFrom) {
 			set(copyFrom.id.c_str(), copyFrom.primitiveType, copyFrom.indices);
+			clusters = copyFrom.clusters;
 		}
 
 		~MeshPart() {
@@ -50,6 +73,7 @@ namespace modeldata {
 
 		void clear() {
 			indices.clear();
+			clusters.clear();
 			id.clear();
 			primitiveType = 0;
 		}
@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "Animation.h"
 #include "Material.h"
 #include "Mesh.h"
@@ -41,13 +42,19 @@ namespace modeldata {
 		std::vector<Material *> materials;
 		std::vector<Mesh *> meshes;
 		std::vector<Node *> nodes;
+		// The nodes (recursively) and materials by id, maintained by addNode, addMaterial and updateIndex
+		std::unordered_map<std::string, Node *> nodeIndex;
+		std::unordered_map<std::string, Material *> materialIndex;
+		// Whether the model only contains the node ids and the animations, the meshes and materials aren't written
+		bool animationsOnly;
 
-		Model() { version[0] = VERSION_HI; version[1] = VERSION_LO; }
+		Model() : animationsOnly(false) { version[0] = VERSION_HI; version[1] = VERSION_LO; }
 
 		Model(const Model &copyFrom) {
 			version[0] = copyFrom.version[0];
 			version[1] = copyFrom.version[1];
 			id = copyFrom.id;
+			animationsOnly = copyFrom.animationsOnly;
 			for (std::vector<Animation *>::const_iterator itr = copyFrom.animations.begin(); itr != copyFrom.animations.end(); ++itr)
 				animations.push_back(new Animation(**itr));
 			for (std::vector<Material *>::const_iterator itr = copyFrom.materials.begin(); itr != copyFrom.materials.end(); ++itr)
@@ -56,6 +63,7 @@ namespace modeldata {
 				meshes.push_back(new Mesh(**itr));
 			for (std::vector<Node *>::const_iterator itr = copyFrom.nodes.begin(); itr != copyFrom.nodes.end(); ++itr)
 				nodes.push_back(new Node(**itr));
+			updateIndex();
 		}
 
 		~Model() {
@@ -75,24 +83,47 @@ namespace modeldata {
 			for (std::vector<Node *>::iterator itr = nodes.begin(); itr != nodes.end(); ++itr)
 				delete *itr;
 			nodes.clear();
+			nodeIndex.clear();
+			materialIndex.clear();
+		}
+
+		/** Add the node to the parent or the root if the parent is null. Returns false if a node with the same id already exists. */
+		bool addNode(Node * const &node, Node * const &parent = 0) {
+			if (!nodeIndex.insert(std::make_pair(node->id, node)).second)
+				return false;
+			if (parent == 0)
+				nodes.push_back(node);
+			else
+				parent->children.push_back(node);
+			return true;
+		}
+
+		/** Add the material. Returns false if a material with the same id already exists. */
+		bool addMaterial(Material * const &material) {
+			if (!materialIndex.insert(std::make_pair(material->id, material)).second)
+				return false;
+			materials.push_back(material);
+			return true;
+		}
+
+		/** Rebuild the index after the nodes or materials are modified directly, the first node or material with an id is used. */
+		void updateIndex() {
+			nodeIndex.clear();
+			materialIndex.clear();
+			for (std::vector<Node *>::const_iterator itr = nodes.begin(); itr != nodes.end(); ++itr)
+				indexNode(*itr);
+			for (std::vector<Material *>::const_iterator itr = materials.begin(); itr != materials.end(); ++itr)
+				materialIndex.insert(std::make_pair((*itr)->id, *itr));
 		}
 
 		Node *getNode(const char *id) const {
-			for (std::vector<Node *>::const_iterator itr = nodes.begin(); itr != nodes.end(); ++itr) {
-				if ((*itr)->id.compare(id)==0)
-					return *itr;
-				Node *cnode = (*itr)->getChild(id);
-				if (cnode != NULL)
-					return cnode;
-			}
-			return NULL;
+			std::unordered_map<std::string, Node *>::const_iterator it = nodeIndex.find(id);
+			return it == nodeIndex.end() ? NULL : it->second;
 		}
 
 		Material *getMaterial(const char *id) const {
-			for (std::vector<Material *>::const_iterator itr = materials.begin(); itr != materials.end(); ++itr)
-				if ((*itr)->id.compare(id)==0)
-					return *itr;
-			return NULL;
+			std::unordered_map<std::string, Material *>::const_iterator it = materialIndex.find(id);
+			return it == materialIndex.end() ? NULL : it->second;
 		}
 
 		size_t getTotalNodeCount() const {
@@ -138,6 +169,12 @@ namespace modeldata {
 		}
 
 		virtual void serialize(json::BaseJSONWriter &writer) const;
+	private:
+		void indexNode(Node * const &node) {
+			nodeIndex.insert(std::make_pair(node->id, node));
+			for (std::vector<Node *>::const_iterator itr = node->children.begin(); itr != node->children.end(); ++itr)
+				indexNode(*itr);
+		}
 	};
 }
 }
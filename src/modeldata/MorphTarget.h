@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif
+#ifndef MODELDATA_MORPHTARGET_H
+#define MODELDATA_MORPHTARGET_H
+
+#include <string>
+#include <vector>
+#include <fbxsdk.h>
+#include "../json/BaseJSONWriter.h"
+
+namespace fbxconv {
+namespace modeldata {
+	/** A blend shape target of a mesh, stored sparse: only the vertices it moves, each with the delta of its position
+	 * (and normal, if the mesh has normals) at full weight. The indices refer to the vertices of the mesh. */
+	struct MorphTarget : public json::ConstSerializable {
+		std::string id;
+		std::vector<unsigned int> indices;
+		/** Three floats per index */
+		std::vector<float> positions;
+		/** Three floats per index, or empty */
+		std::vector<float> normals;
+		FbxBlendShapeChannel *source;
+
+		MorphTarget() : source(0) {}
+
+		virtual void serialize(json::BaseJSONWriter &writer) const;
+	};
+} }
+
+#endif //MODELDATA_MORPHTARGET_H
@@ -21,7 +21,10 @@
 #define MODELDATA_NODEANIMATION_H
 
 #include <vector>
+#include <string>
+#include <string.h>
 #include "Keyframe.h"
+#include "QuantizedKeyframes.h"
 #include "../json/BaseJSONWriter.h"
 
 namespace fbxconv {
@@ -30,24 +33,54 @@ namespace modeldata {
 
 	struct NodeAnimation : public json::ConstSerializable {
 		const Node *node;
-		std::vector<Keyframe *> keyframes;
-		bool translate, rotate, scale;
+		/** The keyframes of each channel, an empty track means the channel isn't animated */
+		Keyframes<3> translation;
+		Keyframes<4> rotation;
+		Keyframes<3> scaling;
+		/** If set, the keyframes are written in this compressed form */
+		QuantizedKeyframes *quantized;
+		/** The offset of the translation, rotation and scaling within a frame of the fixed rate keyframes of the animation, or -1 */
+		int fixedRateOffset[3];
+		/** The weight track of each animated morph target of the node's mesh, by target id */
+		std::vector<std::pair<std::string, Keyframes<1> > > weights;
+		/** The offset of each weight track within a frame of the fixed rate keyframes, empty if the weights aren't resampled */
+		std::vector<int> weightOffsets;
 
-		NodeAnimation() : node(0), translate(false), rotate(false), scale(false) {}
+		NodeAnimation() : node(0), quantized(0) {
+			fixedRateOffset[0] = fixedRateOffset[1] = fixedRateOffset[2] = -1;
+		}
+
+		NodeAnimation(const NodeAnimation &copyFrom)
+			: node(copyFrom.node), translation(copyFrom.translation), rotation(copyFrom.rotation), scaling(copyFrom.scaling),
+			quantized(copyFrom.quantized ? new QuantizedKeyframes(*copyFrom.quantized) : 0), weights(copyFrom.weights),
+			weightOffsets(copyFrom.weightOffsets) {
+			memcpy(fixedRateOffset, copyFrom.fixedRateOffset, sizeof(fixedRateOffset));
+		}
 
-		NodeAnimation(const NodeAnimation &copyFrom) {
+		NodeAnimation &operator=(const NodeAnimation &copyFrom) {
+			if (this == &copyFrom)
+				return *this;
+			QuantizedKeyframes * const copy = copyFrom.quantized ? new QuantizedKeyframes(*copyFrom.quantized) : 0;
+			if (quantized)
+				delete quantized;
+			quantized = copy;
 			node = copyFrom.node;
-			translate = copyFrom.translate;
-			rotate = copyFrom.rotate;
-			scale = copyFrom.scale;
-			for (std::vector<Keyframe *>::const_iterator itr = copyFrom.keyframes.begin(); itr != copyFrom.keyframes.end(); ++itr)
-				keyframes.push_back(new Keyframe(*(*itr)));
+			translation = copyFrom.translation;
+			rotation = copyFrom.rotation;
+			scaling = copyFrom.scaling;
+			weights = copyFrom.weights;
+			weightOffsets = copyFrom.weightOffsets;
+			memcpy(fixedRateOffset, copyFrom.fixedRateOffset, sizeof(fixedRateOffset));
+			return *this;
 		}
 
 		~NodeAnimation() {
-			for (std::vector<Keyframe *>::iterator itr = keyframes.begin(); itr != keyframes.end(); ++itr)
-				if ((*itr)!=0)
-					delete *itr;
+			if (quantized)
+				delete quantized;
+		}
+
+		inline bool empty() const {
+			return translation.empty() && rotation.empty() && scaling.empty() && weights.empty();
 		}
 
 		virtual void serialize(json::BaseJSONWriter &writer) const;
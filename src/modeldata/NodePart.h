@@ -33,12 +33,15 @@ namespace modeldata {
 		const MeshPart *meshPart;
 		const Material *material;
 		std::vector<std::pair<Node *, FbxAMatrix> > bones;
+		/** If not empty, the inverse of the bind pose of each bone is written instead: 16 floats per bone, column major (OpenGL) order */
+		std::vector<float> inverseBindMatrices;
 		std::vector<std::vector<Material::Texture *> > uvMapping;
 
 		NodePart() : meshPart(0), material(0) {}
 
 		NodePart(const NodePart &copyFrom) : meshPart(copyFrom.meshPart), material(copyFrom.material) {
 			bones.insert(bones.end(), copyFrom.bones.begin(), copyFrom.bones.end());
+			inverseBindMatrices = copyFrom.inverseBindMatrices;
 			uvMapping.resize(copyFrom.uvMapping.size());
 			for (unsigned int i = 0; i < uvMapping.size(); i++)
 				uvMapping[i].insert(uvMapping[i].begin(), copyFrom.uvMapping[i].begin(), copyFrom.uvMapping[i].end());
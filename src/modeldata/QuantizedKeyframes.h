@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif
+#ifndef MODELDATA_QUANTIZEDKEYFRAMES_H
+#define MODELDATA_QUANTIZEDKEYFRAMES_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include "Keyframe.h"
+#include "../json/BaseJSONWriter.h"
+
+namespace fbxconv {
+namespace modeldata {
+	/** The tracks of a node animation in compressed form:
+	 * - the key times of each track are stored as uint16 frame indices (time = frame * frameTime), keys which round to the
+	 *   same frame are merged (the last one is kept), so the frame indices are strictly increasing
+	 * - translation, scaling and the morph target weights are stored as uint16 per component: value = min + range * q / 65535
+	 * - rotations are stored as 48 bit smallest three quaternions, in three uint16 (least significant first):
+	 *   bits 0-44 are the three smallest components (15 bits each, in order, mapped from [-1/sqrt(2), 1/sqrt(2)]),
+	 *   bits 45-46 are the index of the omitted largest component, which is always positive. Because of that consecutive keys
+	 *   can end up in opposite hemispheres, so the decoder negates a rotation whose dot product with the previous (decoded)
+	 *   rotation is negative, which makes the interpolation take the shortest path. */
+	struct QuantizedKeyframes : public json::ConstSerializable {
+		float frameTime;
+		std::vector<unsigned short> translationFrames;
+		float translationMin[3], translationRange[3];
+		std::vector<unsigned short> translation;
+		std::vector<unsigned short> rotationFrames;
+		std::vector<unsigned short> rotation;
+		std::vector<unsigned short> scalingFrames;
+		float scalingMin[3], scalingRange[3];
+		std::vector<unsigned short> scaling;
+		/** A morph target weight track */
+		struct Weights {
+			std::vector<unsigned short> frames;
+			float min[1], range[1];
+			std::vector<unsigned short> values;
+			Weights() {
+				min[0] = range[0] = 0.f;
+			}
+		};
+		/** The weight tracks, in the order of the node animation */
+		std::vector<Weights> weights;
+
+		QuantizedKeyframes() : frameTime(0.f) {
+			memset(translationMin, 0, sizeof(translationMin));
+			memset(translationRange, 0, sizeof(translationRange));
+			memset(scalingMin, 0, sizeof(scalingMin));
+			memset(scalingRange, 0, sizeof(scalingRange));
+		}
+
+		/** Encode the tracks, empty tracks aren't stored. Returns the number of merged keys. */
+		size_t set(const float &frameTime, const Keyframes<3> &translation, const Keyframes<4> &rotation, const Keyframes<3> &scaling,
+			const std::vector<std::pair<std::string, Keyframes<1> > > &weights) {
+			this->frameTime = frameTime;
+			std::vector<size_t> keys[3];
+			quantizeFrames(translation.times, frameTime, translationFrames, keys[0]);
+			quantizeFrames(rotation.times, frameTime, rotationFrames, keys[1]);
+			quantizeFrames(scaling.times, frameTime, scalingFrames, keys[2]);
+			quantize(translation, keys[0], translationMin, translationRange, this->translation);
+			quantize(scaling, keys[2], scalingMin, scalingRange, this->scaling);
+			this->rotation.resize(keys[1].size() * 3);
+			for (size_t i = 0; i < keys[1].size(); i++)
+				packRotation(rotation.value(keys[1][i]), &this->rotation[i*3]);
+			size_t merged = translation.size() + rotation.size() + scaling.size() - keys[0].size() - keys[1].size() - keys[2].size();
+			this->weights.resize(weights.size());
+			for (size_t i = 0; i < weights.size(); i++) {
+				Weights &w = this->weights[i];
+				quantizeFrames(weights[i].second.times, frameTime, w.frames, keys[0]);
+				quantize(weights[i].second, keys[0], w.min, w.range, w.values);
+				merged += weights[i].second.size() - keys[0].size();
+			}
+			return merged;
+		}
+
+		/** The reference decoder. */
+		void get(Keyframes<3> &translation, Keyframes<4> &rotation, Keyframes<3> &scaling, std::vector<Keyframes<1> > &weights) const {
+			dequantize(translationFrames, this->translation, translationMin, translationRange, translation);
+			dequantize(scalingFrames, this->scaling, scalingMin, scalingRange, scaling);
+			weights.resize(this->weights.size());
+			for (size_t i = 0; i < weights.size(); i++)
+				dequantize(this->weights[i].frames, this->weights[i].values, this->weights[i].min, this->weights[i].range, weights[i]);
+			rotation.clear();
+			rotation.reserve(rotationFrames.size());
+			for (size_t i = 0; i < rotationFrames.size(); i++) {
+				float q[4];
+				unpackRotation(&this->rotation[i*3], q);
+				if (i > 0) {
+					const float * const p = rotation.value(i - 1);
+					if (p[0] * q[0] + p[1] * q[1] + p[2] * q[2] + p[3] * q[3] < 0.f)
+						for (int j = 0; j < 4; j++)
+							q[j] = -q[j];
+				}
+				rotation.add(rotationFrames[i] * frameTime, q);
+			}
+		}
+
+		/** Round the times to frame indices, keys is set to the index of each kept key. */
+		static void quantizeFrames(const std::vector<float> &times, const float &frameTime, std::vector<unsigned short> &out, std::vector<size_t> &keys) {
+			out.clear();
+			keys.clear();
+			for (size_t i = 0; i < times.size(); i++) {
+				const unsigned short frame = (unsigned short)std::min(65535.f, floorf(times[i] / frameTime + 0.5f));
+				if (!out.empty() && out.back() >= frame)
+					keys.back() = i;
+				else {
+					out.push_back(frame);
+					keys.push_back(i);
+				}
+			}
+		}
+
+		template<int n> static void quantize(const Keyframes<n> &keyframes, const std::vector<size_t> &keys, float *min, float *range, std::vector<unsigned short> &out) {
+			out.resize(keys.size() * n);
+			if (keys.empty())
+				return;
+			for (int j = 0; j < n; j++) {
+				float mn = keyframes.value(keys[0])[j], mx = mn;
+				for (size_t i = 1; i < keys.size(); i++) {
+					mn = std::min(mn, keyframes.value(keys[i])[j]);
+					mx = std::max(mx, keyframes.value(keys[i])[j]);
+				}
+				min[j] = mn;
+				range[j] = mx - mn;
+			}
+			for (size_t i = 0; i < keys.size(); i++)
+				for (int j = 0; j < n; j++)
+					out[i*n+j] = range[j] > 0.f ? (unsigned short)floorf((keyframes.value(keys[i])[j] - min[j]) / range[j] * 65535.f + 0.5f) : 0;
+		}
+
+		template<int n> void dequantize(const std::vector<unsigned short> &frames, const std::vector<unsigned short> &values, const float *min, const float *range, Keyframes<n> &out) const {
+			out.clear();
+			out.reserve(frames.size());
+			for (size_t i = 0; i < frames.size(); i++) {
+				float v[n];
+				for (int j = 0; j < n; j++)
+					v[j] = min[j] + range[j] * values[i*n+j] / 65535.f;
+				out.add(frames[i] * frameTime, v);
+			}
+		}
+
+		static void packRotation(const float *q, unsigned short *out) {
+			int largest = 0;
+			for (int i = 1; i < 4; i++)
+				if (fabsf(q[i]) > fabsf(q[largest]))
+					largest = i;
+			const float sign = q[largest] < 0.f ? -1.f : 1.f;
+			unsigned long long bits = (unsigned long long)largest << 45;
+			for (int i = 0, n = 0; i < 4; i++) {
+				if (i == largest)
+					continue;
+				const float v = std::max(-1.f, std::min(1.f, q[i] * sign * 1.41421356f));
+				bits |= (unsigned long long)floorf((v * 0.5f + 0.5f) * 32767.f + 0.5f) << (15 * n++);
+			}
+			out[0] = (unsigned short)(bits & 0xffff);
+			out[1] = (unsigned short)((bits >> 16) & 0xffff);
+			out[2] = (unsigned short)((bits >> 32) & 0xffff);
+		}
+
+		static void unpackRotation(const unsigned short *in, float *q) {
+			const unsigned long long bits = (unsigned long long)in[0] | ((unsigned long long)in[1] << 16) | ((unsigned long long)in[2] << 32);
+			const int largest = (int)((bits >> 45) & 3);
+			float sum = 0.f;
+			for (int i = 0, n = 0; i < 4; i++) {
+				if (i == largest)
+					continue;
+				q[i] = ((float)((bits >> (15 * n++)) & 0x7fff) / 32767.f * 2.f - 1.f) * 0.70710678f;
+				sum += q[i] * q[i];
+			}
+			q[largest] = sqrtf(std::max(0.f, 1.f - sum));
+		}
+
+		virtual void serialize(json::BaseJSONWriter &writer) const;
+	};
+} }
+
+#endif //MODELDATA_QUANTIZEDKEYFRAMES_H
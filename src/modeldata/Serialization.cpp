@@ -19,9 +19,13 @@
 #include "Animation.h"
 #include "NodeAnimation.h"
 #include "Keyframe.h"
+#include "QuantizedKeyframes.h"
+#include "FixedRateKeyframes.h"
 #include "Material.h"
 #include "Attributes.h"
 #include "MeshPart.h"
+#include "MorphTarget.h"
+#include "VertexAnimation.h"
 #include "Mesh.h"
 #include "Model.h"
 
@@ -76,18 +80,54 @@ void Model::serialize(json::BaseJSONWriter &writer) const {
 	writer.obj(6);
 	writer << "version" = version;
 	writer << "id" = id;
-	writer << "meshes" = meshes;
-	writer << "materials" = materials;
+	if (!animationsOnly) {
+		writer << "meshes" = meshes;
+		writer << "materials" = materials;
+	}
 	writer << "nodes" = nodes;
 	writer << "animations" = animations;
 	writer.end();
 }
 
 void Mesh::serialize(json::BaseJSONWriter &writer) const {
-	writer.obj(3);
+	writer.obj(5);
 	writer << "attributes" = attributes;
 	writer.val("vertices").is().data(vertices, vertexSize);
 	writer << "parts" = parts;
+	if (!targets.empty())
+		writer << "targets" = targets;
+	if (!vertexAnimations.empty())
+		writer << "vertexanimations" = vertexAnimations;
+	writer.end();
+}
+
+void VertexAnimation::serialize(json::BaseJSONWriter &writer) const {
+	writer << json::obj;
+	writer << "animation" = animation;
+	writer << "file" = file;
+	writer << "format" = (half ? "RGBA16F" : "RGBA8");
+	writer << "framerate" = frameRate;
+	writer << "framecount" = frameCount;
+	writer << "width" = width;
+	writer << "height" = height;
+	writer << "rowsperframe" = rowsPerFrame;
+	writer << "normalrow" = normalRow;
+	writer << "uv" = uv;
+	writer << "lookup" = "texels";
+	if (!half) {
+		writer << "min" = min;
+		writer << "range" = range;
+	}
+	writer << json::end;
+}
+
+void MorphTarget::serialize(json::BaseJSONWriter &writer) const {
+	writer.obj(normals.empty() ? 3 : 4);
+	writer << "id" = id;
+	writer.val("indices").is().data(indices, 12);
+	writer.val("positions").is().data(positions, 3);
+	if (!normals.empty())
+		writer.val("normals").is().data(normals, 3);
 	writer.end();
 }
 
@@ -100,10 +140,21 @@ void Attributes::serialize(json::BaseJSONWriter &writer) const {
 }
 
 void MeshPart::serialize(json::BaseJSONWriter &writer) const {
-	writer.obj(3);
+	writer.obj(clusters.empty() ? 3 : 4);
 	writer << "id" = id;
 	writer << "type" = getPrimitiveTypeString(primitiveType);
 	writer.val("indices").is().data(indices, 12);
+	if (!clusters.empty())
+		writer << "clusters" = clusters;
+	writer << json::end;
+}
+
+void MeshPart::Cluster::serialize(json::BaseJSONWriter &writer) const {
+	writer.obj(4);
+	writer << "offset" = offset;
+	writer << "count" = count;
+	writer << "sphere" = sphere;
+	writer << "cone" = cone;
 	writer << json::end;
 }
 
@@ -177,12 +228,16 @@ void NodePart::serialize(json::BaseJSONWriter &writer) const {
 		for (std::vector<std::pair<Node *, FbxAMatrix> >::const_iterator it = bones.begin(); it != bones.end(); ++it) {
 			writer << json::obj;
 			writer << "node" = it->first->id;
-			writeAsFloat(writer, "translation", it->second.GetT().mData);
-			writeAsFloat(writer, "rotation", it->second.GetQ().mData);
-			writeAsFloat(writer, "scale", it->second.GetS().mData);
+			if (inverseBindMatrices.empty()) {
+				writeAsFloat(writer, "translation", it->second.GetT().mData);
+				writeAsFloat(writer, "rotation", it->second.GetQ().mData);
+				writeAsFloat(writer, "scale", it->second.GetS().mData);
+			}
 			writer << json::end;
 		}
 		writer.end();
+		if (!inverseBindMatrices.empty())
+			writer.val("inversebindmatrices").is().data(inverseBindMatrices, 16);
 	}
 	if (!uvMapping.empty()) {
 		writer.val("uvMapping").is().arr(uvMapping.size(), 16);
@@ -198,29 +253,113 @@ void NodePart::serialize(json::BaseJSONWriter &writer) const {
 }
 
 void Animation::serialize(json::BaseJSONWriter &writer) const {
-	writer.obj(2);
+	writer.obj(4);
 	writer << "id" = id;
-	writer << "bones" = nodeAnimations;
+	if (!chunks.empty()) {
+		writer << "chunkfile" = chunkFile;
+		writer << "chunkduration" = chunkDuration;
+		writer << "chunkcount" = (unsigned int)chunks.size();
+	}
+	else {
+		if (fixedRate)
+			writer << "fixedrate" = fixedRate;
+		writer << "bones" = nodeAnimations;
+	}
 	writer.end();
 }
 
+void FixedRateKeyframes::serialize(json::BaseJSONWriter &writer) const {
+	writer << json::obj;
+	writer << "framerate" = frameRate;
+	writer << "framecount" = frameCount;
+	writer << "framesize" = frameSize;
+	writer.val("values").is().data(values, frameSize);
+	writer << json::end;
+}
+
 void NodeAnimation::serialize(json::BaseJSONWriter &writer) const {
-	writer.obj(2);
+	writer.obj(5);
 	writer << "boneId" = node->id;
-	writer << "keyframes" = keyframes;
+	if (quantized)
+		writer << "quantized" = quantized;
+	else if (fixedRateOffset[0] >= 0 || fixedRateOffset[1] >= 0 || fixedRateOffset[2] >= 0) {
+		if (fixedRateOffset[0] >= 0)
+			writer << "translationoffset" = fixedRateOffset[0];
+		if (fixedRateOffset[1] >= 0)
+			writer << "rotationoffset" = fixedRateOffset[1];
+		if (fixedRateOffset[2] >= 0)
+			writer << "scalingoffset" = fixedRateOffset[2];
+	}
+	else {
+		if (!translation.empty())
+			writer << "translation" = translation;
+		if (!rotation.empty())
+			writer << "rotation" = rotation;
+		if (!scaling.empty())
+			writer << "scaling" = scaling;
+	}
+	if (!weights.empty()) {
+		writer.val("weights").is().arr(weights.size());
+		for (size_t i = 0; i < weights.size(); i++) {
+			writer.obj(5);
+			writer << "target" = weights[i].first;
+			if (quantized) {
+				const QuantizedKeyframes::Weights &w = quantized->weights[i];
+				writer.val("frames").is().data(w.frames, 16);
+				writer << "min" = w.min[0];
+				writer << "range" = w.range[0];
+				writer.val("values").is().data(w.values, 16);
+			}
+			else if (!weightOffsets.empty())
+				writer << "offset" = weightOffsets[i];
+			else
+				writer << "keyframes" = weights[i].second;
+			writer.end();
+		}
+		writer.end();
+	}
 	writer.end();
 }
 
-void Keyframe::serialize(json::BaseJSONWriter &writer) const {
+void QuantizedKeyframes::serialize(json::BaseJSONWriter &writer) const {
 	writer << json::obj;
-	writer << "keytime" = time;
-	if (hasRotation)
-		writer << "rotation" = rotation;
-	if (hasScale)
-		writer << "scale" = scale;
-	if (hasTranslation)
-		writer << "translation" = translation;
+	writer << "frametime" = frameTime;
+	if (!translation.empty()) {
+		writer.val("translationframes").is().data(translationFrames, 16);
+		writer << "translationmin" = translationMin;
+		writer << "translationrange" = translationRange;
+		writer.val("translation").is().data(translation, 12);
+	}
+	if (!rotation.empty()) {
+		writer.val("rotationframes").is().data(rotationFrames, 16);
+		writer.val("rotation").is().data(rotation, 12);
+	}
+	if (!scaling.empty()) {
+		writer.val("scalingframes").is().data(scalingFrames, 16);
+		writer << "scalingmin" = scalingMin;
+		writer << "scalingrange" = scalingRange;
+		writer.val("scaling").is().data(scaling, 12);
+	}
 	writer << json::end;
 }
 
+template<int n> void Keyframes<n>::serialize(json::BaseJSONWriter &writer) const {
+	writer.arr(times.size());
+	for (size_t i = 0; i < times.size(); i++) {
+		writer.obj(cubic() ? 4 : 2);
+		writer << "keytime" = times[i];
+		writer.val("value").is().data(value(i), n);
+		if (cubic()) {
+			writer.val("intangent").is().data(&inTangents[i * n], n);
+			writer.val("outtangent").is().data(&outTangents[i * n], n);
+		}
+		writer.end();
+	}
+	writer.end();
+}
+
+template struct Keyframes<1>;
+template struct Keyframes<3>;
+template struct Keyframes<4>;
+
 } }
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif
+#ifndef MODELDATA_VERTEXANIMATION_H
+#define MODELDATA_VERTEXANIMATION_H
+
+#include <string>
+#include <string.h>
+#include "../json/BaseJSONWriter.h"
+
+namespace fbxconv {
+namespace modeldata {
+	/** The (skinned) vertex positions and normals of a mesh at each frame of an animation, baked into an RGBA texture in model space.
+	 * Each frame takes rowsPerFrame rows: vertex i is at column i % width and row frame * rowsPerFrame + i / width, its normal is
+	 * at normalRow rows below that. The lookup texture coordinates of each vertex (uv) contain its column and row within a frame in
+	 * texels (i % width and i / width), which are shared by all animations of the mesh: the texel of a frame is sampled at
+	 * ((u + 0.5) / width, (v + frame * rowsPerFrame + 0.5) / height), adding normalRow to the row for the normal.
+	 * Half float texels are stored as the raw bits in 16 bit channels, 8 bit positions are mapped to [min, min + range]
+	 * and 8 bit normals to [-1, 1]. */
+	struct VertexAnimation : public json::ConstSerializable {
+		/** The id of the animation (stack) */
+		std::string animation;
+		/** The filename of the texture */
+		std::string file;
+		bool half;
+		float frameRate;
+		unsigned int frameCount;
+		unsigned int width, height;
+		unsigned int rowsPerFrame;
+		unsigned int normalRow;
+		/** The index of the texture coordinates containing the lookup of each vertex */
+		unsigned int uv;
+		float min[3], range[3];
+
+		VertexAnimation() : half(true), frameRate(0.f), frameCount(0), width(0), height(0), rowsPerFrame(0), normalRow(0), uv(0) {
+			memset(min, 0, sizeof(min));
+			memset(range, 0, sizeof(range));
+		}
+
+		virtual void serialize(json::BaseJSONWriter &writer) const;
+	};
+} }
+
+#endif //MODELDATA_VERTEXANIMATION_H
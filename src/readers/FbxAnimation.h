@@ -1,18 +1,18 @@
 /*******************************************************************************
-* Copyright 2011 See AUTHORS file.
-*
-* Licensed under the Apache License, Version 2.0 (the "License");
-* you may not use this file except in compliance with the License.
-* You may obtain a copy of the License at
-*
-*   http://www.apache.org/licenses/LICENSE-2.0
-*
-* Unless required by applicable law or agreed to in writing, software
-* distributed under the License is distributed on an "AS IS" BASIS,
-* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-* See the License for the specific language governing permissions and
-* limitations under the License.
-******************************************************************************/
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
 /** @author Xoppa */
 #ifdef _MSC_VER
 #pragma once
@@ -24,8 +24,13 @@
 #include "../Settings.h"
 #include "../log/log.h"
 #include "util.h"
+#include "simd.h"
 #include "../modeldata/Model.h"
 #include <map>
+#include <set>
+#include <cmath>
+#include <chrono>
+#include <mutex>
 
 using namespace fbxconv::modeldata;
 
@@ -37,21 +42,344 @@ namespace readers {
 		Settings *settings;
 		fbxconv::log::Log *log;
 		Model * const model;
-		std::map<const FbxNode *, Node *> nodeMap;
+		const std::map<const FbxNode *, Node *> &nodeMap;
 
-		FbxAnimation(Settings *settings, fbxconv::log::Log *log, Model * const &model, std::map<const FbxNode *, Node *> const &nodeMap)
-			: settings(settings), log(log), model(model), nodeMap(nodeMap)
-		{
+		// The animated properties of a node and the times of the keys that affect it
+		struct NodeKeys {
+			bool translate, rotate, scale;
+			// Whether all keys use constant or linear interpolation
+			bool linear;
+			float framerate;
+			std::vector<FbxLongLong> times;
+			NodeKeys() : translate(false), rotate(false), scale(false), linear(true), framerate(0.f) {}
+		};
 
+		// The local transform of a node at a specific time, from which the keyframes of each track are taken
+		struct Sample {
+			float time;
+			float translation[3];
+			float rotation[4];
+			float scale[3];
+		};
+		// The number of floats between the samples in an array, used to decompose the transforms directly into it
+		static const unsigned int SampleStride = sizeof(Sample) / sizeof(float);
+
+		FbxAnimation(Settings *settings, fbxconv::log::Log *log, Model * const &model, const std::map<const FbxNode *, Node *> &nodeMap)
+			: settings(settings), log(log), model(model), nodeMap(nodeMap) {}
+
+		/** Convert the animation stack, returns null if it doesn't affect any node. */
+		Animation *convert(FbxAnimStack * const &animStack) {
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			Animation *result = 0;
+			const bool sampled = settings->forceFpsSamplesAnimations;
+			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
+			if (sampled)
+				convertAnimationBySampling(animStack, result);
+			else if (layerCount > 1) {
+				// Blend the layers upfront, so the keys can be reduced without evaluating all layers for each transform
+				log->verbose(log::iSourceConvertFbxLayeredAnimation, animStack->GetName(), layerCount);
+				FbxAnimStack *baked = bakeLayers(animStack);
+				convertAnimation(baked, result);
+				animStack->GetScene()->SetCurrentAnimationStack(animStack);
+				std::lock_guard<std::mutex> lock(sdkMutex());
+				baked->Destroy(true);
+			}
+			else
+				convertAnimation(animStack, result);
+			if (settings->morphTargets)
+				addWeights(animStack, result);
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			log->verbose(log::iSourceConvertFbxAnimationTime, animStack->GetName(), sampled ? "sampled" : "keys", ms);
+			if (result && settings->animationChunkDuration > 0.f) {
+				split(result, settings->animationChunkDuration * 1000.f);
+				log->verbose(log::iSourceConvertFbxAnimationChunks, animStack->GetName(), (int)result->chunks.size(), result->chunkFile.c_str());
+				for (std::vector<Animation *>::const_iterator it = result->chunks.begin(); it != result->chunks.end(); ++it) {
+					if (settings->quantizeAnimations && !settings->cubicAnimations)
+						quantize(*it, getFrameRate(animStack->GetScene()));
+				}
+			}
+			else if (result && settings->fixedAnimationRate > 0.f)
+				resample(result, settings->fixedAnimationRate);
+			else if (result && settings->quantizeAnimations && !settings->cubicAnimations)
+				quantize(result, getFrameRate(animStack->GetScene()));
+			return result;
+		}
+
+		/** Guards the creation and destruction of FBX objects, which are registered at the shared manager,
+		 * when multiple stacks are converted concurrently (each on its own copy of the scene). */
+		static std::mutex &sdkMutex() {
+			static std::mutex mutex;
+			return mutex;
+		}
+
+		/** The time of the last keyframe of the animation */
+		static float getDuration(Animation * const &animation) {
+			float duration = 0.f;
+			for (std::vector<NodeAnimation *>::const_iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+				if (!(*it)->translation.empty())
+					duration = std::max(duration, (*it)->translation.times.back());
+				if (!(*it)->rotation.empty())
+					duration = std::max(duration, (*it)->rotation.times.back());
+				if (!(*it)->scaling.empty())
+					duration = std::max(duration, (*it)->scaling.times.back());
+				for (std::vector<std::pair<std::string, Keyframes<1> > >::const_iterator w = (*it)->weights.begin(); w != (*it)->weights.end(); ++w)
+					duration = std::max(duration, w->second.times.back());
+			}
+			return duration;
+		}
+
+		/** Resample the tracks of all node animations at the fixed rate, into one dense block of values stored frame by frame. */
+		void resample(Animation * const &animation, const float &frameRate) {
+			FixedRateKeyframes *fixedRate = new FixedRateKeyframes();
+			fixedRate->frameRate = frameRate;
+			fixedRate->frameCount = (unsigned int)ceilf(getDuration(animation) * frameRate / 1000.f - 0.001f) + 1;
+			for (std::vector<NodeAnimation *>::iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+				NodeAnimation * const &nodeAnim = *it;
+				if (!nodeAnim->translation.empty()) {
+					nodeAnim->fixedRateOffset[0] = fixedRate->frameSize;
+					fixedRate->frameSize += 3;
+				}
+				if (!nodeAnim->rotation.empty()) {
+					nodeAnim->fixedRateOffset[1] = fixedRate->frameSize;
+					fixedRate->frameSize += 4;
+				}
+				if (!nodeAnim->scaling.empty()) {
+					nodeAnim->fixedRateOffset[2] = fixedRate->frameSize;
+					fixedRate->frameSize += 3;
+				}
+				nodeAnim->weightOffsets.resize(nodeAnim->weights.size());
+				for (std::vector<int>::iterator w = nodeAnim->weightOffsets.begin(); w != nodeAnim->weightOffsets.end(); ++w)
+					*w = (int)(fixedRate->frameSize++);
+			}
+			fixedRate->values.resize(fixedRate->frameCount * fixedRate->frameSize);
+			for (std::vector<NodeAnimation *>::iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+				NodeAnimation * const &nodeAnim = *it;
+				resampleTrack(nodeAnim->translation, *fixedRate, nodeAnim->fixedRateOffset[0]);
+				resampleTrack(nodeAnim->rotation, *fixedRate, nodeAnim->fixedRateOffset[1]);
+				resampleTrack(nodeAnim->scaling, *fixedRate, nodeAnim->fixedRateOffset[2]);
+				for (size_t w = 0; w < nodeAnim->weights.size(); w++)
+					resampleTrack(nodeAnim->weights[w].second, *fixedRate, nodeAnim->weightOffsets[w]);
+				// The tracks aren't written anymore (the weights keep their target id)
+				nodeAnim->translation.clear();
+				nodeAnim->rotation.clear();
+				nodeAnim->scaling.clear();
+				for (size_t w = 0; w < nodeAnim->weights.size(); w++)
+					nodeAnim->weights[w].second.clear();
+			}
+			animation->fixedRate = fixedRate;
+		}
+
+		/** Remove the channels which aren't referenced by the node animations anymore (e.g. after pruning) from the fixed rate
+		 * keyframes, updating the offsets of the node animations. */
+		static void compactFixedRate(Animation * const &animation) {
+			FixedRateKeyframes * const &fixedRate = animation->fixedRate;
+			if (!fixedRate)
+				return;
+			static const unsigned int sizes[3] = { 3, 4, 3 };
+			unsigned int frameSize = 0;
+			std::vector<std::pair<unsigned int, unsigned int> > columns; // source offset, size
+			for (std::vector<NodeAnimation *>::iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+				for (int i = 0; i < 3; i++) {
+					if ((*it)->fixedRateOffset[i] < 0)
+						continue;
+					columns.push_back(std::make_pair((unsigned int)(*it)->fixedRateOffset[i], sizes[i]));
+					(*it)->fixedRateOffset[i] = (int)frameSize;
+					frameSize += sizes[i];
+				}
+				for (std::vector<int>::iterator w = (*it)->weightOffsets.begin(); w != (*it)->weightOffsets.end(); ++w) {
+					columns.push_back(std::make_pair((unsigned int)*w, 1u));
+					*w = (int)(frameSize++);
+				}
+			}
+			if (frameSize == fixedRate->frameSize)
+				return;
+			std::vector<float> values(fixedRate->frameCount * frameSize);
+			for (unsigned int f = 0; f < fixedRate->frameCount; f++) {
+				float *out = &values[f * frameSize];
+				for (std::vector<std::pair<unsigned int, unsigned int> >::const_iterator c = columns.begin(); c != columns.end(); ++c) {
+					memcpy(out, &fixedRate->values[f * fixedRate->frameSize + c->first], c->second * sizeof(float));
+					out += c->second;
+				}
+			}
+			fixedRate->values.swap(values);
+			fixedRate->frameSize = frameSize;
+		}
+
+		/** Interpolate the track at each frame of the fixed rate keyframes, cubic rotations are normalized after the interpolation. */
+		template<int n> static void resampleTrack(const Keyframes<n> &track, FixedRateKeyframes &fixedRate, const int &offset) {
+			if (track.empty() || offset < 0)
+				return;
+			for (unsigned int f = 0; f < fixedRate.frameCount; f++) {
+				float * const out = &fixedRate.values[f * fixedRate.frameSize + offset];
+				evaluate(track, (float)f * 1000.f / fixedRate.frameRate, out, 0);
+				if (n == 4 && track.cubic()) {
+					const float len = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] + out[3] * out[3]);
+					for (int i = 0; len > 0.f && i < n; i++)
+						out[i] /= len;
+				}
+			}
+		}
+
+		/** The value of the track at the time, clamped to the first and last key. Rotations (n = 4) are interpolated spherically,
+		 * unless the track is cubic. The tangent (per millisecond, optional) is only calculated for cubic tracks. */
+		template<int n> static void evaluate(const Keyframes<n> &track, const float &time, float * const &value, float * const &tangent) {
+			const size_t k = (size_t)(std::upper_bound(track.times.begin(), track.times.end(), time) - track.times.begin());
+			if (k == 0 || k >= track.size()) {
+				memcpy(value, track.value(k == 0 ? 0 : k - 1), n * sizeof(float));
+				if (tangent)
+					memset(tangent, 0, n * sizeof(float));
+				return;
+			}
+			const float dt = track.times[k] - track.times[k - 1];
+			const float alpha = dt > 0.f ? (time - track.times[k - 1]) / dt : 0.f;
+			const float *p1 = track.value(k - 1), *p2 = track.value(k);
+			if (track.cubic()) {
+				const float s2 = alpha * alpha, s3 = s2 * alpha;
+				const float h00 = 2.f * s3 - 3.f * s2 + 1.f, h10 = (s3 - 2.f * s2 + alpha) * dt, h01 = -2.f * s3 + 3.f * s2, h11 = (s3 - s2) * dt;
+				const float *m1 = &track.outTangents[(k - 1) * n], *m2 = &track.inTangents[k * n];
+				for (int i = 0; i < n; i++)
+					value[i] = h00 * p1[i] + h10 * m1[i] + h01 * p2[i] + h11 * m2[i];
+				if (tangent && dt > 0.f) {
+					const float d00 = (6.f * s2 - 6.f * alpha) / dt, d10 = 3.f * s2 - 4.f * alpha + 1.f, d01 = -d00, d11 = 3.f * s2 - 2.f * alpha;
+					for (int i = 0; i < n; i++)
+						tangent[i] = d00 * p1[i] + d10 * m1[i] + d01 * p2[i] + d11 * m2[i];
+				}
+				else if (tangent)
+					memcpy(tangent, m1, n * sizeof(float));
+			}
+			else if (n == 4)
+				slerp(value, p1, p2, alpha);
+			else
+				for (int i = 0; i < n; i++)
+					value[i] = p1[i] + alpha * (p2[i] - p1[i]);
+		}
+
+		/** Split the tracks of the animation in chunks of the duration (milliseconds). Each chunk contains the keys within its
+		 * window plus a key at both boundaries, so it can be played without the other chunks. The node animations are kept,
+		 * but only the chunks are written. */
+		void split(Animation * const &animation, const float &duration) {
+			const float length = getDuration(animation);
+			const unsigned int count = std::max(1u, (unsigned int)ceilf(length / duration - 0.001f));
+			for (unsigned int c = 0; c < count; c++) {
+				const float start = c * duration, end = std::min(length, start + duration);
+				Animation *chunk = new Animation();
+				chunk->id = animation->id;
+				for (std::vector<NodeAnimation *>::const_iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+					NodeAnimation *nodeAnim = new NodeAnimation();
+					nodeAnim->node = (*it)->node;
+					splitTrack((*it)->translation, start, end, nodeAnim->translation);
+					splitTrack((*it)->rotation, start, end, nodeAnim->rotation);
+					splitTrack((*it)->scaling, start, end, nodeAnim->scaling);
+					for (std::vector<std::pair<std::string, Keyframes<1> > >::const_iterator w = (*it)->weights.begin(); w != (*it)->weights.end(); ++w) {
+						nodeAnim->weights.push_back(std::make_pair(w->first, Keyframes<1>()));
+						splitTrack(w->second, start, end, nodeAnim->weights.back().second);
+					}
+					chunk->nodeAnimations.push_back(nodeAnim);
+				}
+				animation->chunks.push_back(chunk);
+			}
+			animation->chunkDuration = duration;
+			animation->chunkFile = getBaseName(settings->outFile) + "_" + getSafeFileName(animation->id) + ".g3dc";
+		}
+
+		/** Add the keys of the track within [start, end], along with an interpolated key at start and end if needed. Outside its keys
+		 * the track is clamped, so the boundary keys are only added within the keys (or if there's no key within the window). */
+		template<int n> static void splitTrack(const Keyframes<n> &track, const float &start, const float &end, Keyframes<n> &out) {
+			if (track.empty())
+				return;
+			float value[n], tangent[n];
+			const size_t first = (size_t)(std::lower_bound(track.times.begin(), track.times.end(), start) - track.times.begin());
+			const size_t last = (size_t)(std::upper_bound(track.times.begin(), track.times.end(), end) - track.times.begin());
+			out.reserve(last - first + 2, track.cubic());
+			if ((first == last || start > track.times.front()) && (first >= track.size() || track.times[first] > start)) {
+				evaluate(track, start, value, tangent);
+				addKey(out, start, value, track.cubic() ? tangent : 0);
+			}
+			for (size_t k = first; k < last; k++) {
+				if (track.cubic())
+					out.add(track.times[k], track.value(k), &track.inTangents[k * n], &track.outTangents[k * n]);
+				else
+					out.add(track.times[k], track.value(k));
+			}
+			if (end > start && end < track.times.back() && (last == 0 || track.times[last - 1] < end)) {
+				evaluate(track, end, value, tangent);
+				addKey(out, end, value, track.cubic() ? tangent : 0);
+			}
+		}
+
+		template<int n> inline static void addKey(Keyframes<n> &track, const float &time, const float *value, const float *tangent) {
+			if (tangent)
+				track.add(time, value, tangent, tangent);
+			else
+				track.add(time, value);
+		}
+
+		/** Compress the tracks of each node animation and check the round trip error using the reference decoder. */
+		void quantize(Animation * const &animation, const float &frameRate) {
+			const float duration = getDuration(animation);
+			// Use the frame rate of the scene as time unit, unless the frame indices wouldn't fit in 16 bits
+			const float frameTime = std::max(1000.f / frameRate, duration / 65535.f);
+
+			// The error of the decoded tracks at the time of each source key, which includes the rounding of the key times
+			float maxError[4] = {0.f, 0.f, 0.f, 0.f}, maxTimeError = 0.f, value[4];
+			size_t merged = 0;
+			Keyframes<3> translation, scaling;
+			Keyframes<4> rotation;
+			std::vector<Keyframes<1> > weights;
+			for (std::vector<NodeAnimation *>::iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it) {
+				NodeAnimation * const &nodeAnim = *it;
+				nodeAnim->quantized = new QuantizedKeyframes();
+				merged += nodeAnim->quantized->set(frameTime, nodeAnim->translation, nodeAnim->rotation, nodeAnim->scaling, nodeAnim->weights);
+				nodeAnim->quantized->get(translation, rotation, scaling, weights);
+				for (size_t i = 0; i < nodeAnim->translation.size(); i++) {
+					evaluate(translation, nodeAnim->translation.times[i], value, 0);
+					for (int j = 0; j < 3; j++)
+						maxError[0] = std::max(maxError[0], std::abs(value[j] - nodeAnim->translation.value(i)[j]));
+				}
+				for (size_t i = 0; i < nodeAnim->rotation.size(); i++) {
+					evaluate(rotation, nodeAnim->rotation.times[i], value, 0);
+					maxError[1] = std::max(maxError[1], quaternionAngle(value, nodeAnim->rotation.value(i)));
+				}
+				for (size_t i = 0; i < nodeAnim->scaling.size(); i++) {
+					evaluate(scaling, nodeAnim->scaling.times[i], value, 0);
+					for (int j = 0; j < 3; j++)
+						maxError[2] = std::max(maxError[2], std::abs(value[j] - nodeAnim->scaling.value(i)[j]));
+				}
+				maxTimeError = std::max(maxTimeError, getTimeError(nodeAnim->translation.times, translation.times));
+				maxTimeError = std::max(maxTimeError, getTimeError(nodeAnim->rotation.times, rotation.times));
+				maxTimeError = std::max(maxTimeError, getTimeError(nodeAnim->scaling.times, scaling.times));
+				for (size_t w = 0; w < weights.size(); w++) {
+					const Keyframes<1> &source = nodeAnim->weights[w].second;
+					for (size_t i = 0; i < source.size(); i++) {
+						evaluate(weights[w], source.times[i], value, 0);
+						maxError[3] = std::max(maxError[3], std::abs(value[0] - source.value(i)[0]));
+					}
+					maxTimeError = std::max(maxTimeError, getTimeError(source.times, weights[w].times));
+				}
+			}
+			log->verbose(log::iSourceConvertFbxQuantizedAnimation, animation->id.c_str(), maxError[0], maxError[1], maxError[2], maxError[3], maxTimeError, (int)merged);
 		}
 
-		inline static const char *getInterpolationName(FbxAnimCurveDef::EInterpolationType iType) {
-			switch (iType) {
-			case FbxAnimCurveDef::eInterpolationConstant: return "constant";
-			case FbxAnimCurveDef::eInterpolationLinear: return "linear";
-			case FbxAnimCurveDef::eInterpolationCubic: return "cubic";
+		/** The maximum difference between each source key time and the nearest decoded key time (milliseconds). */
+		static float getTimeError(const std::vector<float> &times, const std::vector<float> &decoded) {
+			float result = 0.f;
+			for (std::vector<float>::const_iterator it = times.begin(); it != times.end(); ++it) {
+				const std::vector<float>::const_iterator k = std::lower_bound(decoded.begin(), decoded.end(), *it);
+				float error = FLT_MAX;
+				if (k != decoded.end())
+					error = *k - *it;
+				if (k != decoded.begin())
+					error = std::min(error, *it - k[-1]);
+				result = std::max(result, error);
 			}
-			return "unknown";
+			return result;
+		}
+
+		/** The frame rate of the time mode of the scene. */
+		static float getFrameRate(FbxScene * const &scene) {
+			const FbxTime::EMode mode = scene->GetGlobalSettings().GetTimeMode();
+			const double frameRate = mode == FbxTime::eCustom ? scene->GetGlobalSettings().GetCustomFrameRate() : FbxTime::GetFrameRate(mode);
+			return frameRate > 0. ? (float)frameRate : (float)FbxTime::GetFrameRate(FbxTime::eDefaultMode);
 		}
 
 		static const unsigned short PropTranslation = 1;
@@ -59,205 +387,535 @@ namespace readers {
 		static const unsigned short PropScaling = 3;
 		unsigned short getPropertyType(FbxAnimStack * const &animStack, FbxProperty const &prop, FbxNode * &node) {
 			node = static_cast<FbxNode *>(prop.GetFbxObject());
+			if (!node)
+				return 0;
 			FbxString propName = prop.GetName();
-			if (propName.Compare("DeformPercent") != 0)
-			{
-				if (node->LclTranslation.IsValid() && propName.Compare(node->LclTranslation.GetName()) == 0)
-					return PropTranslation;
-				if (node->LclRotation.IsValid() && propName.Compare(node->LclRotation.GetName()) == 0)
-					return PropRotation;
-				if (node->LclScaling.IsValid() && propName.Compare(node->LclScaling.GetName()) == 0)
-					return PropScaling;
-			}
-			log->warning(log::wSourceConvertFbxSkipPropname, animStack->GetName(), (const char *)propName);
+			if (propName == "DeformPercent") {
+				// The weights of the morph targets are added separately
+				if (settings->morphTargets)
+					return 0;
+				// When using this propName in model an unhandled exception is launched in sentence node->LclTranslation.GetName()
+				log->warning(log::wSourceConvertFbxSkipPropname, animStack->GetName(), (const char *)propName);
+				return 0;
+			}
+			if (node->LclTranslation.IsValid() && propName == node->LclTranslation.GetName())
+				return PropTranslation;
+			if (node->LclRotation.IsValid() && propName == node->LclRotation.GetName())
+				return PropRotation;
+			if (node->LclScaling.IsValid() && propName == node->LclScaling.GetName())
+				return PropScaling;
 			return 0;
 		}
 
-		Animation *convert(FbxAnimStack * const &animStack) {
-			Animation *result = 0;
-			if (settings->forceFpsSamplesAnimations || !convertAnimation(animStack, result)) {
-				log->warning(log::wSourceConvertFbxFallbackAnimation, animStack->GetName());
-				convertAnimationBySampling(animStack, result);
+		/** Add the specified animation by creating keyframes at the times of the actual curve keys. Segments between the keys
+		 * which can't be interpolated linearly (e.g. cubic interpolation, euler rotation or blended layers) are subdivided
+		 * until the interpolation is within the tolerance. */
+		void convertAnimation(FbxAnimStack * const &animStack, Animation * &result) {
+			FbxTimeSpan animTimeSpan = animStack->GetLocalTimeSpan();
+			const FbxLongLong animStart = animTimeSpan.GetStart().Get();
+			FbxLongLong animStop = animTimeSpan.GetStop().Get();
+			if (animStop <= animStart)
+				animStop = FBXSDK_LONGLONG_MAX;
+
+			std::map<FbxNode *, NodeKeys> affectedNodes;
+			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
+			for (int l = 0; l < layerCount; l++) {
+				FbxAnimLayer *layer = animStack->GetMember<FbxAnimLayer>(l);
+				const int curveNodeCount = layer->GetSrcObjectCount<FbxAnimCurveNode>();
+				for (int n = 0; n < curveNodeCount; n++) {
+					FbxAnimCurveNode *curveNode = layer->GetSrcObject<FbxAnimCurveNode>(n);
+					const int propertyCount = curveNode->GetDstPropertyCount();
+					for (int p = 0; p < propertyCount; p++) {
+						FbxProperty prop = curveNode->GetDstProperty(p);
+						FbxNode *node;
+						const unsigned short type = getPropertyType(animStack, prop, node);
+						if (!type)
+							continue;
+						NodeKeys &keys = affectedNodes[node];
+						keys.translate = keys.translate || type == PropTranslation;
+						keys.rotate = keys.rotate || type == PropRotation;
+						keys.scale = keys.scale || type == PropScaling;
+						FbxAnimCurve *curve;
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_X))
+							addKeyTimes(animStack, node, curve, keys, animStart, animStop);
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Y))
+							addKeyTimes(animStack, node, curve, keys, animStart, animStop);
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Z))
+							addKeyTimes(animStack, node, curve, keys, animStart, animStop);
+					}
+				}
 			}
-			return result;
-		}
 
-		inline static int indexOfNodeAnimation(Animation * const &animation, Node * const &node) {
-			int index = 0;
-			for (std::vector<NodeAnimation *>::const_iterator it = animation->nodeAnimations.begin(); it != animation->nodeAnimations.end(); ++it, ++index) {
-				if ((*it)->node == node)
-					return index;
+			if (affectedNodes.empty())
+				return;
+
+			Animation *animation = new Animation();
+			animation->id = animStack->GetName();
+			animStack->GetScene()->SetCurrentAnimationStack(animStack);
+
+			std::vector<Sample> frames;
+			for (std::map<FbxNode *, NodeKeys>::iterator itr = affectedNodes.begin(); itr != affectedNodes.end(); ++itr) {
+				std::map<const FbxNode *, Node *>::const_iterator it = nodeMap.find(itr->first);
+				if (it == nodeMap.end())
+					continue;
+				std::vector<FbxLongLong> &times = itr->second.times;
+				if (times.empty())
+					continue;
+				std::sort(times.begin(), times.end());
+				times.erase(std::unique(times.begin(), times.end()), times.end());
+
+				// Linear keys on translation and scaling only are interpolated linearly by the transform as well
+				const bool linear = itr->second.linear && !itr->second.rotate && layerCount == 1;
+				FbxTime minStep;
+				minStep.SetSecondDouble(itr->second.framerate > 0.f ? 1.0 / itr->second.framerate : 0.001);
+
+				frames.clear();
+				frames.push_back(createSample(itr->first, times[0], animStart));
+				for (unsigned int i = 1; i < times.size(); i++) {
+					const Sample k1 = frames.back(), k2 = createSample(itr->first, times[i], animStart);
+					if (!linear)
+						subdivideSegment(itr->first, k1, k2, times[i-1], times[i], minStep.Get(), animStart, frames);
+					frames.push_back(k2);
+				}
+
+				NodeAnimation *nodeAnim = new NodeAnimation();
+				nodeAnim->node = it->second;
+				addKeyframes(nodeAnim, frames);
+				if (!nodeAnim->empty())
+					animation->nodeAnimations.push_back(nodeAnim);
+				else
+					delete nodeAnim;
 			}
-			return -1;
+
+			if (animation->nodeAnimations.empty())
+				delete animation;
+			else
+				result = animation;
 		}
 
-		inline static int addNodeAnimationIfNotEmpty(Animation * const &animation, NodeAnimation * const &nodeAnimation, bool const &deleteIfEmpty) {
-			if (nodeAnimation) {
-				if ((nodeAnimation->rotate && !nodeAnimation->rotation.empty()) ||
-					(nodeAnimation->translate && !nodeAnimation->translation.empty()) ||
-					(nodeAnimation->scale && !nodeAnimation->scaling.empty())) {
-					animation->nodeAnimations.push_back(nodeAnimation);
-					return animation->nodeAnimations.size() - 1;
+		/** Add the weight track of each morph target of which the blend shape channel is animated, to the animation of the node
+		 * using the mesh. The weight (DeformPercent / 100) is evaluated at the keys of all layers and at each frame within
+		 * non-linear segments, after which the keys which can be interpolated are removed using the scale tolerance. */
+		void addWeights(FbxAnimStack * const &animStack, Animation * &result) {
+			FbxTimeSpan animTimeSpan = animStack->GetLocalTimeSpan();
+			const FbxLongLong animStart = animTimeSpan.GetStart().Get();
+			FbxLongLong animStop = animTimeSpan.GetStop().Get();
+			if (animStop <= animStart)
+				animStop = FBXSDK_LONGLONG_MAX;
+			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
+			animStack->GetScene()->SetCurrentAnimationStack(animStack);
+
+			for (std::map<const FbxNode *, Node *>::const_iterator itr = nodeMap.begin(); itr != nodeMap.end(); ++itr) {
+				FbxGeometry *geometry = itr->first->GetGeometry();
+				// The morph targets refer to the channels of the source scene, which might differ from the one being converted
+				FbxGeometry *sourceGeometry = itr->second->source ? itr->second->source->GetGeometry() : 0;
+				if (!geometry || !sourceGeometry)
+					continue;
+				NodeAnimation *nodeAnim = 0;
+				const int deformerCount = geometry->GetDeformerCount(FbxDeformer::eBlendShape);
+				for (int d = 0; d < deformerCount; d++) {
+					FbxBlendShape *blendShape = static_cast<FbxBlendShape*>(geometry->GetDeformer(d, FbxDeformer::eBlendShape));
+					FbxBlendShape *sourceShape = static_cast<FbxBlendShape*>(sourceGeometry->GetDeformer(d, FbxDeformer::eBlendShape));
+					const int channelCount = blendShape->GetBlendShapeChannelCount();
+					for (int c = 0; c < channelCount; c++) {
+						const MorphTarget *target = findMorphTarget(sourceShape->GetBlendShapeChannel(c));
+						if (!target)
+							continue;
+						NodeKeys keys;
+						for (int l = 0; l < layerCount; l++) {
+							FbxAnimCurve *curve = geometry->GetShapeChannel(d, c, animStack->GetMember<FbxAnimLayer>(l));
+							if (curve)
+								addKeyTimes(animStack, const_cast<FbxNode *>(itr->first), curve, keys, animStart, animStop);
+						}
+						if (keys.times.empty())
+							continue;
+						Keyframes<1> weights;
+						sampleWeights(blendShape->GetBlendShapeChannel(c), keys, layerCount > 1, animStart, weights);
+						if (weights.empty())
+							continue;
+						if (!nodeAnim)
+							nodeAnim = getNodeAnimation(animStack, result, itr->second);
+						nodeAnim->weights.push_back(std::make_pair(target->id, weights));
+					}
 				}
-				if (deleteIfEmpty)
-					delete nodeAnimation;
 			}
-			return -1;
 		}
 
-		template<int n>
-		void cleanupKeyframes(std::vector<Keyframe<n>> &keyframes, float *defaultValue) {
-			for (int i = 1; i < (keyframes.size() - 1);) {
-				Keyframe<n> &k1 = keyframes[i - 1];
-				Keyframe<n> &k2 = keyframes[i];
-				Keyframe<n> &k3 = keyframes[i + 1];
-				if (isLerp(k1.value, k1.time, k2.value, k2.time, k3.value, k3.time, n))
-					keyframes.erase(keyframes.begin() + i);
-				else
-					++i;
-			}
-			if ((keyframes.size() == 2) && (cmp(keyframes[0].value, keyframes[1].value, n)))
-				keyframes.erase(keyframes.begin() + 1);
-			if ((keyframes.size() == 1) && (cmp(keyframes[0].value, defaultValue, n)))
-				keyframes.clear();
-		}
-
-		bool addTranslationKeyframes(NodeAnimation * const &nodeAnimation, FbxNode *node, FbxAnimCurve * const &curve) {
-			assert(nodeAnimation->translation.empty());
-			int keyCount = curve->KeyGetCount();
-			for (int keyIndex = 0; keyIndex < keyCount; ++keyIndex) {
-				FbxTime keyTime = curve->KeyGetTime(keyIndex);
-				FbxVector4 localTranslation = node->EvaluateLocalTranslation(keyTime);
-				Keyframe<3> kf;
-				kf.time = (float)(1000.0 * keyTime.GetSecondDouble());
-				kf.value[0] = localTranslation.mData[0];
-				kf.value[1] = localTranslation.mData[1];
-				kf.value[2] = localTranslation.mData[2];
-				nodeAnimation->translation.push_back(kf);
-			}
-			cleanupKeyframes<3>(nodeAnimation->translation, (float*)nodeAnimation->node->transform.translation);
-			nodeAnimation->translate = !nodeAnimation->translation.empty();
-			return true;
+		const MorphTarget *findMorphTarget(const FbxBlendShapeChannel * const &channel) const {
+			for (std::vector<Mesh *>::const_iterator itr = model->meshes.begin(); itr != model->meshes.end(); ++itr)
+				for (std::vector<MorphTarget *>::const_iterator it = (*itr)->targets.begin(); it != (*itr)->targets.end(); ++it)
+					if ((*it)->source == channel)
+						return *it;
+			return 0;
 		}
 
-		bool addRotationKeyframes(NodeAnimation * const &nodeAnimation, FbxNode *node, FbxAnimCurve * const &curve) {
-			assert(nodeAnimation->rotation.empty());
-			int keyCount = curve->KeyGetCount();
-			for (int keyIndex = 0; keyIndex < keyCount; ++keyIndex) {
-				FbxTime keyTime = curve->KeyGetTime(keyIndex);
-				FbxAMatrix tmp;
-				tmp.SetR(node->EvaluateLocalRotation(keyTime));
-				FbxQuaternion localRotation = tmp.GetQ();
-				Keyframe<4> kf;
-				kf.time = (float)(1000.0 * keyTime.GetSecondDouble());
-				kf.value[0] = localRotation.mData[0];
-				kf.value[1] = localRotation.mData[1];
-				kf.value[2] = localRotation.mData[2];
-				kf.value[3] = localRotation.mData[3];
-				nodeAnimation->rotation.push_back(kf);
-			}
-			int start = nodeAnimation->rotation.size();
-			cleanupKeyframes<4>(nodeAnimation->rotation, (float*)nodeAnimation->node->transform.rotation);
-			int end = nodeAnimation->rotation.size();
-			if (end != start)
-				printf("Removed %d - %d = %d keyframes\n", start, end, start - end);
-			nodeAnimation->rotate = !nodeAnimation->rotation.empty();
-			return true;
+		/** The animation of the node within the result, which is created if needed. */
+		NodeAnimation *getNodeAnimation(FbxAnimStack * const &animStack, Animation * &result, const Node * const &node) {
+			if (!result) {
+				result = new Animation();
+				result->id = animStack->GetName();
+			}
+			for (std::vector<NodeAnimation *>::const_iterator itr = result->nodeAnimations.begin(); itr != result->nodeAnimations.end(); ++itr)
+				if ((*itr)->node == node)
+					return *itr;
+			NodeAnimation *nodeAnim = new NodeAnimation();
+			nodeAnim->node = node;
+			result->nodeAnimations.push_back(nodeAnim);
+			return nodeAnim;
 		}
 
-		/** Add the specified animation by adding the actual keyframes of components the animation consist of */
-		bool convertAnimation(FbxAnimStack * const &animStack, Animation * &result) {
-			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
-			if (layerCount != 1) {
-				log->warning(log::wSourceConvertFbxLayeredAnimation, animStack->GetName(), layerCount);
-				return false;
+		/** Evaluate the weight of the channel at the key times and reduce it to the keyframes needed for linear interpolation.
+		 * Leaves the keyframes empty if the weight is zero throughout. */
+		void sampleWeights(FbxBlendShapeChannel * const &channel, NodeKeys &keys, const bool &blended, const FbxLongLong &animStart, Keyframes<1> &out) {
+			std::vector<FbxLongLong> &times = keys.times;
+			std::sort(times.begin(), times.end());
+			times.erase(std::unique(times.begin(), times.end()), times.end());
+			if ((blended || !keys.linear) && keys.framerate > 0.f) {
+				FbxTime step;
+				step.SetSecondDouble(1.0 / keys.framerate);
+				const size_t count = times.size();
+				for (size_t i = 1; i < count; i++)
+					for (FbxLongLong t = times[i-1] + step.Get(); t < times[i] - step.Get() / 2; t += step.Get())
+						times.push_back(t);
+				std::sort(times.begin(), times.end());
 			}
 
-			bool success = true;
-			Animation *animation = new Animation();
-			animation->id = animStack->GetName();
-			animStack->GetScene()->SetCurrentAnimationStack(animStack);
+			Keyframes<1> samples;
+			samples.reserve(times.size());
+			bool animated = false;
+			for (std::vector<FbxLongLong>::const_iterator t = times.begin(); t != times.end(); ++t) {
+				const float weight = (float)(channel->DeformPercent.EvaluateValue(FbxTime(*t)) * 0.01);
+				samples.add((float)(1000.0 * FbxTime(*t - animStart).GetSecondDouble()), &weight);
+				animated = animated || std::abs(weight) > settings->animationScaleTolerance;
+			}
+			if (!animated)
+				return;
 
-			// There should only be one layer (layers are used for blending animations)
-			for (int layerIndex = 0; success && layerIndex < layerCount; ++layerIndex) {
-				FbxAnimLayer *layer = animStack->GetMember<FbxAnimLayer>(layerIndex);
-				Node *node = 0;
-				NodeAnimation *nodeAnimation = 0;
-				int nodeAnimationIndex = -1;
-				const int curveNodeCount = layer->GetSrcObjectCount<FbxAnimCurveNode>();
-				// Each node affected by this animation (although the fbx design doesnt seem to restrict it to a single node, which is why the node is fetched per property)
-				for (int curveNodeIndex = 0; success && curveNodeIndex < curveNodeCount; ++curveNodeIndex) {
-					FbxAnimCurveNode *curveNode = layer->GetSrcObject<FbxAnimCurveNode>(curveNodeIndex);
-
-					const int curveCount = curveNode->GetCurveCount(0U);
-					if (curveCount != 1) {
-						log->warning(log::wSourceConvertFbxMultipleCurves, animStack->GetName(), curveCount);
-						success = false;
-						break;
+			// Ramer-Douglas-Peucker, like reduceKeyframes
+			const int last = (int)samples.size() - 1;
+			std::vector<bool> keep(samples.size(), false);
+			keep[0] = keep[last] = true;
+			std::vector<std::pair<int, int> > ranges;
+			ranges.push_back(std::make_pair(0, last));
+			while (!ranges.empty()) {
+				const int first = ranges.back().first, end = ranges.back().second;
+				ranges.pop_back();
+				const float duration = samples.times[end] - samples.times[first];
+				float maxError = settings->animationScaleTolerance;
+				int index = -1;
+				for (int i = first + 1; i < end; i++) {
+					const float alpha = duration > 0.f ? (samples.times[i] - samples.times[first]) / duration : 0.f;
+					const float error = std::abs(samples.values[i] - (samples.values[first] + alpha * (samples.values[end] - samples.values[first])));
+					if (error > maxError) {
+						maxError = error;
+						index = i;
 					}
+				}
+				if (index >= 0) {
+					keep[index] = true;
+					ranges.push_back(std::make_pair(first, index));
+					ranges.push_back(std::make_pair(index, end));
+				}
+			}
+			for (size_t i = 0; i < samples.size(); i++)
+				if (keep[i])
+					out.add(samples.times[i], &samples.values[i]);
+		}
+
+		/** Blend the curves of the layers into a new animation stack with a single layer, using the weight, blend mode, mute
+		 * and solo setting of each layer. Each blended curve gets a linear key at the key times of the source curves and
+		 * at each frame within non-linear segments, which are reduced along with the other keys later on. Only the creation
+		 * of the FBX objects is guarded by the sdk mutex, the blending itself runs concurrently. */
+		FbxAnimStack *bakeLayers(FbxAnimStack * const &animStack) {
+			FbxScene *scene = animStack->GetScene();
+			FbxTimeSpan animTimeSpan = animStack->GetLocalTimeSpan();
+			const FbxLongLong animStart = animTimeSpan.GetStart().Get();
+			FbxLongLong animStop = animTimeSpan.GetStop().Get();
+			if (animStop <= animStart)
+				animStop = FBXSDK_LONGLONG_MAX;
 
-					FbxAnimCurve *curve = curveNode->GetCurve(0U);
-					FbxAnimCurveDef::EInterpolationType itype = curve->KeyGetInterpolation(0);
+			std::vector<FbxAnimLayer *> layers;
+			bool solo = false;
+			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
+			for (int l = 0; l < layerCount; l++)
+				solo = solo || animStack->GetMember<FbxAnimLayer>(l)->Solo.Get();
+			for (int l = 0; l < layerCount; l++) {
+				FbxAnimLayer *layer = animStack->GetMember<FbxAnimLayer>(l);
+				if (!layer->Mute.Get() && (!solo || layer->Solo.Get()))
+					layers.push_back(layer);
+			}
 
-					unsigned short prop;
-					FbxNode *fbxNode = 0;
+			std::set<std::pair<FbxNode *, unsigned short> > properties;
+			for (std::vector<FbxAnimLayer *>::const_iterator it = layers.begin(); it != layers.end(); ++it) {
+				const int curveNodeCount = (*it)->GetSrcObjectCount<FbxAnimCurveNode>();
+				for (int n = 0; n < curveNodeCount; n++) {
+					FbxAnimCurveNode *curveNode = (*it)->GetSrcObject<FbxAnimCurveNode>(n);
 					const int propertyCount = curveNode->GetDstPropertyCount();
-					// Each property of this node affected (keyed) by this animation
-					for (int propertyIndex = 0; success && propertyIndex < propertyCount; ++propertyIndex) {
-						if (!(prop = getPropertyType(animStack, curveNode->GetDstProperty(propertyIndex), fbxNode)))
-							continue;
-						std::map<const FbxNode *, Node *>::iterator it = nodeMap.find(fbxNode);
-						if (it == nodeMap.end()) {
-							log->warning(log::wSourceConvertFbxUnknownNodeAnim, animStack->GetName(), fbxNode->GetName());
-							continue;
-						}
-						if (node != it->second) {
-							if (nodeAnimationIndex < 0)
-								addNodeAnimationIfNotEmpty(animation, nodeAnimation, true);
-							node = it->second;
-							nodeAnimationIndex = indexOfNodeAnimation(animation, node);
-							if (nodeAnimationIndex < 0)
-								(nodeAnimation = new NodeAnimation())->node = node;
-							else
-								nodeAnimation = animation->nodeAnimations.at(nodeAnimationIndex);
+					for (int p = 0; p < propertyCount; p++) {
+						FbxNode *node;
+						const unsigned short type = getPropertyType(animStack, curveNode->GetDstProperty(p), node);
+						if (type)
+							properties.insert(std::make_pair(node, type));
+					}
+				}
+			}
+
+			FbxAnimStack *baked;
+			FbxAnimLayer *bakedLayer;
+			{
+				std::lock_guard<std::mutex> lock(sdkMutex());
+				baked = FbxAnimStack::Create(scene, animStack->GetName());
+				baked->SetLocalTimeSpan(animTimeSpan);
+				bakedLayer = FbxAnimLayer::Create(scene, "Baked");
+				baked->AddMember(bakedLayer);
+			}
+
+			static const char * const components[3] = { FBXSDK_CURVENODE_COMPONENT_X, FBXSDK_CURVENODE_COMPONENT_Y, FBXSDK_CURVENODE_COMPONENT_Z };
+			std::vector<FbxAnimCurve *> curves(layers.size() * 3);
+			for (std::set<std::pair<FbxNode *, unsigned short> >::const_iterator it = properties.begin(); it != properties.end(); ++it) {
+				FbxNode * const &node = it->first;
+				FbxPropertyT<FbxDouble3> &prop = it->second == PropTranslation ? node->LclTranslation :
+					(it->second == PropRotation ? node->LclRotation : node->LclScaling);
+				// The rotation components are blended together, the other properties per component
+				const unsigned int groupSize = it->second == PropRotation ? 3 : 1;
+				for (unsigned int first = 0; first < 3; first += groupSize) {
+					NodeKeys keys;
+					for (unsigned int l = 0; l < layers.size(); l++)
+						for (unsigned int c = first; c < first + groupSize; c++)
+							if (curves[l * 3 + c] = prop.GetCurve(layers[l], components[c]))
+								addKeyTimes(animStack, node, curves[l * 3 + c], keys, animStart, animStop);
+					std::vector<FbxLongLong> &times = keys.times;
+					if (times.empty())
+						continue;
+					std::sort(times.begin(), times.end());
+					times.erase(std::unique(times.begin(), times.end()), times.end());
+					if (!keys.linear && keys.framerate > 0.f) {
+						FbxTime step;
+						step.SetSecondDouble(1.0 / keys.framerate);
+						const size_t count = times.size();
+						for (size_t i = 1; i < count; i++)
+							for (FbxLongLong t = times[i-1] + step.Get(); t < times[i] - step.Get() / 2; t += step.Get())
+								times.push_back(t);
+						std::sort(times.begin(), times.end());
+					}
+					FbxAnimCurve *bakedCurves[3];
+					{
+						std::lock_guard<std::mutex> lock(sdkMutex());
+						prop.GetCurveNode(bakedLayer, true);
+						for (unsigned int c = first; c < first + groupSize; c++)
+							bakedCurves[c] = prop.GetCurve(bakedLayer, components[c], true);
+					}
+					for (unsigned int c = first; c < first + groupSize; c++)
+						bakedCurves[c]->KeyModifyBegin();
+					if (it->second == PropRotation)
+						bakeRotation(node, prop, layers, curves, times, bakedCurves);
+					else {
+						const FbxDouble3 rest = prop.Get();
+						for (std::vector<FbxLongLong>::const_iterator t = times.begin(); t != times.end(); ++t) {
+							const FbxTime time(*t);
+							const float value = (float)blendLayers(layers, curves, prop, it->second, first, rest[first], time);
+							bakedCurves[first]->KeySet(bakedCurves[first]->KeyAdd(time), time, value, FbxAnimCurveDef::eInterpolationLinear);
 						}
+					}
+					for (unsigned int c = first; c < first + groupSize; c++)
+						bakedCurves[c]->KeyModifyEnd();
+				}
+			}
+			return baked;
+		}
 
-						if (prop == PropTranslation)
-							success = success && addTranslationKeyframes(nodeAnimation, fbxNode, curve);
-						else if (prop == PropRotation)
-							success = success && addRotationKeyframes(nodeAnimation, fbxNode, curve);
+		/** The value of a component of the property at the specified time, blended over the layers. */
+		double blendLayers(const std::vector<FbxAnimLayer *> &layers, const std::vector<FbxAnimCurve *> &curves, FbxProperty &prop, const unsigned short &type, const unsigned int &component, const double &rest, const FbxTime &time) {
+			double value = rest;
+			for (unsigned int l = 0; l < layers.size(); l++) {
+				FbxAnimCurveNode *curveNode = prop.GetCurveNode(layers[l]);
+				if (!curveNode)
+					continue;
+				FbxAnimCurve * const &curve = curves[l * 3 + component];
+				const double v = curve ? (double)curve->Evaluate(time) : curveNode->GetChannelValue<double>(component, rest);
+				const double weight = layers[l]->Weight.Get() * 0.01;
+				if ((FbxAnimLayer::EBlendMode)layers[l]->BlendMode.Get() != FbxAnimLayer::eBlendAdditive)
+					value += weight * (v - value);
+				else if (type != PropScaling)
+					value += weight * v;
+				else if ((FbxAnimLayer::EScaleAccumulationMode)layers[l]->ScaleAccumulationMode.Get() == FbxAnimLayer::eScaleMultiply)
+					value *= 1.0 + weight * (v - 1.0);
+				else
+					value += weight * (v - 1.0);
+			}
+			return value;
+		}
 
-						//printf("Anim(%s).Layer(%s).CurveNode(%s).Node(%s).Prop(%d).Keys[%d] = %s\n", animStack->GetName(), layer->GetName(), curveNode->GetName(), node->id.c_str(), prop, keyCount, getInterpolationName(itype));
+		/** Blend the rotation (euler angles in the rotation order of the node) over the layers at each time. Layers which accumulate
+		 * the rotation per layer are blended as quaternions (slerp when overriding, concatenated when additive), the others per
+		 * channel. The resulting angles are kept continuous with the previous key, so the linear keys don't interpolate the long way. */
+		void bakeRotation(FbxNode * const &node, FbxPropertyT<FbxDouble3> &prop, const std::vector<FbxAnimLayer *> &layers, const std::vector<FbxAnimCurve *> &curves, const std::vector<FbxLongLong> &times, FbxAnimCurve * const * const &out) {
+			EFbxRotationOrder order = eEulerXYZ;
+			node->GetRotationOrder(FbxNode::eSourcePivot, order);
+			FbxRotationOrder rotationOrder(order);
+			// The axis of the middle rotation, which determines the alternative angles of the same rotation
+			static const int middleAxis[7] = { 1, 2, 2, 0, 0, 1, 1 };
+			const int middle = middleAxis[order >= eEulerXYZ && order <= eSphericXYZ ? order : 0];
+			const FbxDouble3 rest = prop.Get();
+			FbxVector4 previous(rest[0], rest[1], rest[2]);
+			for (std::vector<FbxLongLong>::const_iterator t = times.begin(); t != times.end(); ++t) {
+				const FbxTime time(*t);
+				FbxVector4 value(rest[0], rest[1], rest[2]);
+				for (unsigned int l = 0; l < layers.size(); l++) {
+					FbxAnimCurveNode *curveNode = prop.GetCurveNode(layers[l]);
+					if (!curveNode)
+						continue;
+					FbxVector4 v;
+					for (unsigned int c = 0; c < 3; c++)
+						v[c] = curves[l * 3 + c] ? (double)curves[l * 3 + c]->Evaluate(time) : curveNode->GetChannelValue<double>(c, rest[c]);
+					const double weight = layers[l]->Weight.Get() * 0.01;
+					const bool additive = (FbxAnimLayer::EBlendMode)layers[l]->BlendMode.Get() == FbxAnimLayer::eBlendAdditive;
+					if ((FbxAnimLayer::ERotationAccumulationMode)layers[l]->RotationAccumulationMode.Get() == FbxAnimLayer::eRotationByChannel) {
+						for (unsigned int c = 0; c < 3; c++)
+							value[c] += additive ? weight * v[c] : weight * (v[c] - value[c]);
 					}
+					else
+						value = blendRotation(rotationOrder, value, v, weight, additive);
 				}
-				if (nodeAnimationIndex < 0)
-					addNodeAnimationIfNotEmpty(animation, nodeAnimation, true);
+				value = closestRotation(value, previous, middle);
+				previous = value;
+				for (unsigned int c = 0; c < 3; c++)
+					out[c]->KeySet(out[c]->KeyAdd(time), time, (float)value[c], FbxAnimCurveDef::eInterpolationLinear);
 			}
+		}
 
-			if (!success)
-				delete animation;
-			else if (animation->nodeAnimations.empty()) {
-				log->warning(log::wSourceConvertFbxSkipAnimation, animation->id.c_str());
-				delete animation;
+		/** Blend the euler rotation with the other, as quaternions. */
+		static FbxVector4 blendRotation(FbxRotationOrder &order, const FbxVector4 &value, const FbxVector4 &other, const double &weight, const bool &additive) {
+			FbxAMatrix m1, m2;
+			order.V2M(m1, value);
+			order.V2M(m2, other);
+			const FbxQuaternion q1 = m1.GetQ(), q2 = m2.GetQ();
+			float a[4], b[4], q[4];
+			for (int i = 0; i < 4; i++) {
+				a[i] = (float)q1[i];
+				b[i] = (float)q2[i];
 			}
-			else
-				result = animation;
+			if (additive) {
+				// The weighted rotation of the layer, applied after the current rotation
+				static const float identity[4] = { 0.f, 0.f, 0.f, 1.f };
+				slerp(q, identity, b, (float)weight);
+				m2.SetQ(FbxQuaternion(q[0], q[1], q[2], q[3]));
+				m1 = m1 * m2;
+			}
+			else {
+				slerp(q, a, b, (float)weight);
+				m1.SetQ(FbxQuaternion(q[0], q[1], q[2], q[3]));
+			}
+			FbxVector4 result;
+			order.M2V(result, m1);
+			return result;
+		}
 
-			return success;
+		/** The euler angles of the same rotation which are closest to the previous angles: either the angles themselves or the
+		 * alternative (+180 degrees for the outer axes, 180 minus the angle for the middle axis), each wrapped by 360 degrees. */
+		static FbxVector4 closestRotation(const FbxVector4 &value, const FbxVector4 &previous, const int &middle) {
+			FbxVector4 result[2] = { value, value };
+			double distance[2] = { 0., 0. };
+			for (int c = 0; c < 3; c++)
+				result[1][c] = c == middle ? 180. - value[c] : value[c] + 180.;
+			for (int i = 0; i < 2; i++) {
+				for (int c = 0; c < 3; c++) {
+					result[i][c] += 360. * floor((previous[c] - result[i][c]) / 360. + 0.5);
+					distance[i] += fabs(previous[c] - result[i][c]);
+				}
+			}
+			return distance[1] < distance[0] ? result[1] : result[0];
 		}
 
+		/** Add the key times of the curve within the animation time span. */
+		void addKeyTimes(FbxAnimStack * const &animStack, FbxNode * const &node, FbxAnimCurve * const &curve, NodeKeys &keys, const FbxLongLong &animStart, const FbxLongLong &animStop) {
+			const int keyCount = curve->KeyGetCount();
+			if (keyCount > 0)
+				keys.framerate = std::max(keys.framerate, (float)curve->KeyGetTime(0).GetFrameRate(FbxTime::eDefaultMode));
+			for (int k = 0; k < keyCount; k++) {
+				const FbxLongLong time = curve->KeyGetTime(k).Get();
+				keys.times.push_back(std::min(animStop, std::max(animStart, time)));
+				switch (curve->KeyGetInterpolation(k)) {
+				case FbxAnimCurveDef::eInterpolationConstant:
+					// Hold the value until just before the next key
+					if (k + 1 < keyCount) {
+						const FbxLongLong next = curve->KeyGetTime(k + 1).Get();
+						FbxTime hold;
+						hold.SetMilliSeconds(1);
+						const FbxLongLong holdTime = next - std::min(hold.Get(), (next - time) / 2);
+						if (holdTime > animStart && holdTime < animStop)
+							keys.times.push_back(holdTime);
+					}
+					break;
+				case FbxAnimCurveDef::eInterpolationLinear:
+					break;
+				case FbxAnimCurveDef::eInterpolationCubic:
+					keys.linear = false;
+					break;
+				default:
+					if (keys.linear)
+						log->verbose(log::iSourceConvertFbxUnsupportedInterpolation, animStack->GetName(), node->GetName());
+					keys.linear = false;
+					break;
+				}
+			}
+		}
+
+		Sample createSample(FbxNode * const &node, const FbxLongLong &time, const FbxLongLong &animStart) {
+			Sample sample;
+			sample.time = (float)(1000.0 * FbxTime(time - animStart).GetSecondDouble());
+			setSample(sample, node->EvaluateLocalTransform(FbxTime(time)));
+			return sample;
+		}
+
+		inline static void setSample(Sample &sample, const FbxAMatrix &m) {
+			double matrix[16];
+			getMatrix(m, matrix);
+			simd::decomposeTransforms(matrix, sample.translation, sample.rotation, sample.scale, SampleStride, 1);
+#ifdef _DEBUG
+			// Round trip check against the SDK, both paths use the same decomposition
+			const FbxQuaternion q = m.GetQ();
+			const float expected[4] = { (float)q[0], (float)q[1], (float)q[2], (float)q[3] };
+			assert(quaternionAngle(expected, sample.rotation) < 0.1f);
+#endif
+		}
+
+		inline static void getMatrix(const FbxAMatrix &m, double * const &out) {
+			for (int r = 0; r < 4; r++)
+				for (int c = 0; c < 4; c++)
+					out[r * 4 + c] = m.Get(r, c);
+		}
+
+		/** Add the samples needed in between k1 and k2 (exclusive), by splitting the segment in half until the transform
+		 * within each part matches the interpolation of its boundaries or until the part is shorter than the minimum step. */
+		void subdivideSegment(FbxNode * const &node, const Sample &k1, const Sample &k2, const FbxLongLong &start, const FbxLongLong &stop, const FbxLongLong &minStep, const FbxLongLong &animStart, std::vector<Sample> &out) {
+			if (stop - start <= minStep || isLinearSegment(node, k1, k2, start, stop, animStart))
+				return;
+			const FbxLongLong mid = start + (stop - start) / 2;
+			const Sample k = createSample(node, mid, animStart);
+			subdivideSegment(node, k1, k, start, mid, minStep, animStart, out);
+			out.push_back(k);
+			subdivideSegment(node, k, k2, mid, stop, minStep, animStart, out);
+		}
+
+		/** Check whether the transform of the node at a few points within the segment matches the interpolated transform at the segment boundaries. */
+		bool isLinearSegment(FbxNode * const &node, const Sample &k1, const Sample &k2, const FbxLongLong &start, const FbxLongLong &stop, const FbxLongLong &animStart) {
+			const float duration = k2.time - k1.time;
+			for (int i = 1; i < 4; i++) {
+				const Sample k = createSample(node, start + (stop - start) * i / 4, animStart);
+				if (getKeyframeError(k1, k, k2, duration > 0.f ? (k.time - k1.time) / duration : 0.f, true, true, true) > 1.f)
+					return false;
+			}
+			return true;
+		}
 
 		////////////////////////////////////////////////////////////////
 		//// OLDER (v0.1) SAMPLING BASED ANIMATIONS BELOW THIS LINE ////
 		////////////////////////////////////////////////////////////////
 
 		/** Add the specified animation to the model by samples the affected nodes transforms for each keyframe */
-		void convertAnimationBySampling(FbxAnimStack * const &animStack, Animation * &animation) {
-			static std::vector<Keyframe<3>> translationKeyFrames;
-			static std::vector<Keyframe<4>> rotationKeyFrames;
-			static std::vector<Keyframe<3>> scalingKeyFrames;
-			static std::map<FbxNode *, AnimInfo> affectedNodes;
-			affectedNodes.clear();
+		void convertAnimationBySampling(FbxAnimStack * const &animStack, Animation * &result) {
+			std::map<FbxNode *, AnimInfo> affectedNodes;
 
 			FbxTimeSpan animTimeSpan = animStack->GetLocalTimeSpan();
 			float animStart = (float)(animTimeSpan.GetStart().GetMilliSeconds());
@@ -277,35 +935,23 @@ namespace readers {
 					const int nc = curveNode->GetDstPropertyCount();
 					for (int o = 0; o < nc; o++) {
 						FbxProperty prop = curveNode->GetDstProperty(o);
-						FbxNode *node = static_cast<FbxNode *>(prop.GetFbxObject());
-						if (node) {
-							FbxString propName = prop.GetName();
-							if (propName == "DeformPercent")
-							{
-								// When using this propName in model an unhandled exception is launched in sentence node->LclTranslation.GetName()
-								log->warning(log::wSourceConvertFbxSkipPropname, animStack->GetName(), (const char *)propName);
-								continue;
-							}
-
-							// Only add translation, scaling or rotation
-							if ((!node->LclTranslation.IsValid() || propName != node->LclTranslation.GetName()) &&
-								(!node->LclScaling.IsValid() || propName != node->LclScaling.GetName()) &&
-								(!node->LclRotation.IsValid() || propName != node->LclRotation.GetName()))
-								continue;
-							FbxAnimCurve *curve;
-							AnimInfo ts;
-							ts.translate = propName == node->LclTranslation.GetName();
-							ts.rotate = propName == node->LclRotation.GetName();
-							ts.scale = propName == node->LclScaling.GetName();
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_X))
-								updateAnimTime(curve, ts, animStart, animStop);
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Y))
-								updateAnimTime(curve, ts, animStart, animStop);
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Z))
-								updateAnimTime(curve, ts, animStart, animStop);
-							//if (ts.start < ts.stop)
+						FbxNode *node;
+						const unsigned short type = getPropertyType(animStack, prop, node);
+						if (!type)
+							continue;
+						FbxAnimCurve *curve;
+						AnimInfo ts;
+						ts.translate = type == PropTranslation;
+						ts.rotate = type == PropRotation;
+						ts.scale = type == PropScaling;
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_X))
+							updateAnimTime(curve, ts, animStart, animStop);
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Y))
+							updateAnimTime(curve, ts, animStart, animStop);
+						if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Z))
+							updateAnimTime(curve, ts, animStart, animStop);
+						//if (ts.start < ts.stop)
 							affectedNodes[node] += ts;
-						}
 					}
 				}
 			}
@@ -313,61 +959,70 @@ namespace readers {
 			if (affectedNodes.empty())
 				return;
 
-			animation = new Animation();
+			Animation *animation = new Animation();
 			animation->id = animStack->GetName();
 			animStack->GetScene()->SetCurrentAnimationStack(animStack);
 
-			// Add the NodeAnimations to the Animation
+			// Gather the sample times of all nodes, so the whole hierarchy is evaluated at once for each time
+			std::vector<FbxNode *> nodes;
+			std::vector<std::vector<Sample> > frames;
+			std::vector<std::pair<float, unsigned int> > samples;
 			for (std::map<FbxNode *, AnimInfo>::const_iterator itr = affectedNodes.begin(); itr != affectedNodes.end(); itr++) {
-				Node *node = model->getNode((*itr).first->GetName());
-				if (!node)
+				if (nodeMap.find((*itr).first) == nodeMap.end())
 					continue;
-				translationKeyFrames.clear();
-				rotationKeyFrames.clear();
-				scalingKeyFrames.clear();
-				NodeAnimation *nodeAnim = new NodeAnimation();
-				nodeAnim->node = node;
-				nodeAnim->translate = (*itr).second.translate;
-				nodeAnim->rotate = (*itr).second.rotate;
-				nodeAnim->scale = (*itr).second.scale;
+				const unsigned int index = (unsigned int)nodes.size();
+				nodes.push_back((*itr).first);
+				frames.push_back(std::vector<Sample>());
 				const float stepSize = (*itr).second.framerate <= 0.f ? (*itr).second.stop - (*itr).second.start : 1000.f / (*itr).second.framerate;
 				const float last = (*itr).second.stop + stepSize * 0.5f;
-				FbxTime fbxTime;
-				// Calculate all keyframes upfront
-				for (float time = (*itr).second.start; time <= last; time += stepSize) {
+				const size_t first = samples.size();
+				// Without a frame rate and duration the step would be zero, use a single sample instead
+				if (stepSize <= 0.f)
+					samples.push_back(std::make_pair((*itr).second.start, index));
+				else for (float time = (*itr).second.start; time <= last; time += stepSize) {
 					time = std::min(time, (*itr).second.stop);
-					fbxTime.SetMilliSeconds((FbxLongLong)time);
-					Keyframe<3> kfT;
-					Keyframe<4> kfR;
-					Keyframe<3> kfS;
-					kfT.time = (time - animStart);
-					kfR.time = (time - animStart);
-					kfS.time = (time - animStart);
-					FbxAMatrix *m = &(*itr).first->EvaluateLocalTransform(fbxTime);
-					FbxVector4 v = m->GetT();
-					kfT.value[0] = (float)v.mData[0];
-					kfT.value[1] = (float)v.mData[1];
-					kfT.value[2] = (float)v.mData[2];
-					FbxQuaternion q = m->GetQ();
-					kfR.value[0] = (float)q.mData[0];
-					kfR.value[1] = (float)q.mData[1];
-					kfR.value[2] = (float)q.mData[2];
-					kfR.value[3] = (float)q.mData[3];
-					v = m->GetS();
-					kfS.value[0] = (float)v.mData[0];
-					kfS.value[1] = (float)v.mData[1];
-					kfS.value[2] = (float)v.mData[2];
-					translationKeyFrames.push_back(kfT);
-					rotationKeyFrames.push_back(kfR);
-					scalingKeyFrames.push_back(kfS);
+					samples.push_back(std::make_pair(time, index));
 				}
+				frames.back().reserve(samples.size() - first);
+			}
+			std::sort(samples.begin(), samples.end());
+
+			// Evaluate all transforms upfront and decompose them per node in one batch
+			FbxAnimEvaluator *evaluator = animStack->GetScene()->GetAnimationEvaluator();
+			std::vector<std::vector<double> > matrices(nodes.size());
+			for (unsigned int n = 0; n < nodes.size(); n++)
+				matrices[n].reserve(frames[n].capacity() * 16);
+			FbxTime fbxTime;
+			for (unsigned int i = 0; i < samples.size(); i++) {
+				if (i == 0 || samples[i].first != samples[i-1].first)
+					fbxTime.SetSecondDouble(samples[i].first * 0.001);
+				std::vector<double> &m = matrices[samples[i].second];
+				m.resize(m.size() + 16);
+				getMatrix(evaluator->GetNodeLocalTransform(nodes[samples[i].second], fbxTime), &m[m.size() - 16]);
+				Sample sample;
+				sample.time = (samples[i].first - animStart);
+				frames[samples[i].second].push_back(sample);
+			}
+			for (unsigned int n = 0; n < nodes.size(); n++)
+				if (!frames[n].empty())
+					simd::decomposeTransforms(&matrices[n][0], frames[n][0].translation, frames[n][0].rotation, frames[n][0].scale, SampleStride, (unsigned int)frames[n].size());
+
+			// Add the NodeAnimations to the Animation
+			for (unsigned int n = 0; n < nodes.size(); n++) {
+				NodeAnimation *nodeAnim = new NodeAnimation();
+				nodeAnim->node = nodeMap.find(nodes[n])->second;
 				// Only add keyframes really needed
-				addKeyframes(nodeAnim, translationKeyFrames, rotationKeyFrames, scalingKeyFrames);
-				if (nodeAnim->rotate || nodeAnim->scale || nodeAnim->translate)
+				addKeyframes(nodeAnim, frames[n]);
+				if (!nodeAnim->empty())
 					animation->nodeAnimations.push_back(nodeAnim);
 				else
 					delete nodeAnim;
 			}
+
+			if (animation->nodeAnimations.empty())
+				delete animation;
+			else
+				result = animation;
 		}
 
 		inline void updateAnimTime(FbxAnimCurve *const &curve, AnimInfo &ts, const float &animStart, const float &animStop) {
@@ -381,79 +1036,223 @@ namespace readers {
 			ts.framerate = std::max(ts.framerate, (float)stop.GetFrameRate(FbxTime::eDefaultMode));
 		}
 
-		void addKeyframes(NodeAnimation *const &anim, std::vector<Keyframe<3>> &translationKeyFrames, std::vector<Keyframe<4>> &rotationKeyFrames, std::vector<Keyframe<3>> &scalingKeyFrames) {
-			bool translate = false, rotate = false, scale = false;
-			// Check which components are actually changed
-			for (std::vector<Keyframe<3>>::const_iterator itr = translationKeyFrames.begin(); itr != translationKeyFrames.end(); ++itr) {
-				if (!translate && !cmp(anim->node->transform.translation, itr->value, 3))
-					translate = true;
+		/** The largest error of the channels of k compared to the interpolation of k1 and k2, relative to the tolerance of each channel.
+		 * The keyframe is needed if the error is more than one. */
+		float getKeyframeError(const Sample &k1, const Sample &k, const Sample &k2, const float &alpha, const bool &translate, const bool &rotate, const bool &scale) const {
+			float result = 0.f;
+			if (translate) {
+				float d = 0.f;
+				for (int i = 0; i < 3; i++) {
+					const float v = k.translation[i] - (k1.translation[i] + alpha * (k2.translation[i] - k1.translation[i]));
+					d += v * v;
+				}
+				result = std::max(result, sqrtf(d) / settings->animationPositionTolerance);
 			}
-			for (std::vector<Keyframe<4>>::const_iterator itr = rotationKeyFrames.begin(); itr != rotationKeyFrames.end(); ++itr) {
-				if (!rotate && !cmp(anim->node->transform.rotation, itr->value, 4))
-					rotate = true;
+			if (rotate) {
+				float q[4];
+				slerp(q, k1.rotation, k2.rotation, alpha);
+				result = std::max(result, quaternionAngle(q, k.rotation) / settings->animationRotationTolerance);
 			}
-			for (std::vector<Keyframe<3>>::const_iterator itr = scalingKeyFrames.begin(); itr != scalingKeyFrames.end(); ++itr) {
-				if (!scale && !cmp(anim->node->transform.scale, itr->value, 3))
+			if (scale) {
+				for (int i = 0; i < 3; i++) {
+					const float s = k1.scale[i] + alpha * (k2.scale[i] - k1.scale[i]);
+					const float e = std::abs(s) > FLT_EPSILON ? k.scale[i] / s - 1.f : k.scale[i];
+					result = std::max(result, std::abs(e) / settings->animationScaleTolerance);
+				}
+			}
+			return result;
+		}
+
+		/** Add the tracks of the channels which are animated, each reduced to the keyframes needed for that channel alone. */
+		void addKeyframes(NodeAnimation *const &anim, std::vector<Sample> &samples) {
+			if (samples.empty())
+				return;
+			// Keep the quaternions in the same hemisphere, so consecutive keyframes interpolate along the shortest path
+			for (unsigned int i = 1; i < samples.size(); i++)
+				simd::alignQuaternion(samples[i-1].rotation, samples[i].rotation);
+
+			// Check which channels are actually changed, this allows to only export the tracks actually needed. Without the
+			// rest pose (animations only) the base model might differ from it, so the animated channels are always kept.
+			Sample rest;
+			rest.time = 0.f;
+			memcpy(rest.translation, anim->node->transform.translation, sizeof(rest.translation));
+			memcpy(rest.rotation, anim->node->transform.rotation, sizeof(rest.rotation));
+			memcpy(rest.scale, anim->node->transform.scale, sizeof(rest.scale));
+			bool translate = settings->animationsOnly, rotate = settings->animationsOnly, scale = settings->animationsOnly;
+			for (std::vector<Sample>::const_iterator itr = samples.begin(); itr != samples.end(); ++itr) {
+				if (!translate && getKeyframeError(rest, *itr, rest, 0.f, true, false, false) > 1.f)
+					translate = true;
+				if (!rotate && getKeyframeError(rest, *itr, rest, 0.f, false, true, false) > 1.f)
+					rotate = true;
+				if (!scale && getKeyframeError(rest, *itr, rest, 0.f, false, false, true) > 1.f)
 					scale = true;
 			}
-			// This allows to only export the values actual needed
-			anim->translate = translate;
-			anim->rotate = rotate;
-			anim->scale = scale;
-
-			if (translate && !translationKeyFrames.empty()) {
-				anim->translation.push_back(translationKeyFrames[0]);
-				const int last = (int)translationKeyFrames.size() - 1;
-				Keyframe<3> k1 = translationKeyFrames[0], k2, k3;
-				for (int i = 1; i < last; i++) {
-					k2 = translationKeyFrames[i];
-					k3 = translationKeyFrames[i + 1];
-					// Check if the middle keyframe can be calculated by information, if so dont add it
-					if (translate && !isLerp(k1.value, k1.time, k2.value, k2.time, k3.value, k3.time, 3)) {
-						anim->translation.push_back(k2);
-						k1 = k2;
+
+			std::vector<bool> keep;
+			if (translate) {
+				reduceKeyframes(samples, keep, true, false, false);
+				addTrack(anim->translation, samples, keep, &Sample::translation);
+			}
+			if (rotate) {
+				reduceKeyframes(samples, keep, false, true, false);
+				addTrack(anim->rotation, samples, keep, &Sample::rotation);
+			}
+			if (scale) {
+				reduceKeyframes(samples, keep, false, false, true);
+				addTrack(anim->scaling, samples, keep, &Sample::scale);
+			}
+		}
+
+		/** Ramer-Douglas-Peucker: keep the sample with the largest error of the specified channels within a range and split the range at it */
+		void reduceKeyframes(const std::vector<Sample> &samples, std::vector<bool> &keep, const bool &translate, const bool &rotate, const bool &scale) const {
+			const int last = (int)samples.size() - 1;
+			keep.assign(samples.size(), false);
+			keep[0] = keep[last] = true;
+			std::vector<std::pair<int, int> > ranges;
+			ranges.push_back(std::make_pair(0, last));
+			while (!ranges.empty()) {
+				const int first = ranges.back().first, end = ranges.back().second;
+				ranges.pop_back();
+				const Sample &k1 = samples[first], &k2 = samples[end];
+				const float duration = k2.time - k1.time;
+				float maxError = 1.f;
+				int index = -1;
+				if (settings->cubicAnimations)
+					index = getCubicSegmentError(samples, first, end, translate, rotate, scale);
+				else for (int i = first + 1; i < end; i++) {
+					const float alpha = duration > 0.f ? (samples[i].time - k1.time) / duration : 0.f;
+					const float error = getKeyframeError(k1, samples[i], k2, alpha, translate, rotate, scale);
+					if (error > maxError) {
+						maxError = error;
+						index = i;
 					}
 				}
-				if (last > 0)
-					anim->translation.push_back(translationKeyFrames[last]);
-			}
-
-			if (rotate && !rotationKeyFrames.empty()) {
-				anim->rotation.push_back(rotationKeyFrames[0]);
-				const int last = (int)rotationKeyFrames.size() - 1;
-				Keyframe<4> k1 = rotationKeyFrames[0], k2, k3;
-				for (int i = 1; i < last; i++) {
-					k2 = rotationKeyFrames[i];
-					k3 = rotationKeyFrames[i + 1];
-					// Check if the middle keyframe can be calculated by information, if so dont add it
-					if (rotate && !isLerp(k1.value, k1.time, k2.value, k2.time, k3.value, k3.time, 4)) {
-						anim->rotation.push_back(k2);
-						k1 = k2;
-					}
+				if (index >= 0) {
+					keep[index] = true;
+					ranges.push_back(std::make_pair(first, index));
+					ranges.push_back(std::make_pair(index, end));
+				}
+			}
+		}
+
+		/** The tangent (per millisecond) at the sample from, estimated using the samples towards the sample to (the other end of the
+		 * segment): the three point difference if the segment contains at least three samples, otherwise the slope of the two. */
+		inline static void getTangent(const std::vector<Sample> &samples, const int &from, const int &to, Sample &out) {
+			const int dir = to > from ? 1 : -1;
+			const Sample &k0 = samples[from], &k1 = samples[from + dir];
+			const float h1 = k1.time - k0.time;
+			float w0 = 0.f, w1 = 0.f, w2 = 0.f;
+			if ((to - from) * dir >= 2) {
+				const float h2 = samples[from + 2 * dir].time - k0.time;
+				if (h1 != 0.f && h2 != h1) {
+					w0 = -(h1 + h2) / (h1 * h2);
+					w1 = h2 / (h1 * (h2 - h1));
+					w2 = -h1 / (h2 * (h2 - h1));
 				}
-				if (last > 0)
-					anim->rotation.push_back(rotationKeyFrames[last]);
-			}
-
-			if (scale && !scalingKeyFrames.empty()) {
-				anim->scaling.push_back(scalingKeyFrames[0]);
-				const int last = (int)scalingKeyFrames.size() - 1;
-				Keyframe<3> k1 = scalingKeyFrames[0], k2, k3;
-				for (int i = 1; i < last; i++) {
-					k2 = scalingKeyFrames[i];
-					k3 = scalingKeyFrames[i + 1];
-					// Check if the middle keyframe can be calculated by information, if so dont add it
-					if (scale && !isLerp(k1.value, k1.time, k2.value, k2.time, k3.value, k3.time, 3)) {
-						anim->scaling.push_back(k2);
-						k1 = k2;
+			}
+			else if (h1 != 0.f) {
+				w0 = -1.f / h1;
+				w1 = 1.f / h1;
+			}
+			const Sample &k2 = w2 != 0.f ? samples[from + 2 * dir] : k1;
+			for (int j = 0; j < 3; j++) {
+				out.translation[j] = w0 * k0.translation[j] + w1 * k1.translation[j] + w2 * k2.translation[j];
+				out.scale[j] = w0 * k0.scale[j] + w1 * k1.scale[j] + w2 * k2.scale[j];
+			}
+			for (int j = 0; j < 4; j++)
+				out.rotation[j] = w0 * k0.rotation[j] + w1 * k1.rotation[j] + w2 * k2.rotation[j];
+		}
+
+		/** The cubic hermite interpolation at the time between k1 and k2, using the tangents m1 and m2 (per millisecond). */
+		inline static void hermite(const Sample &k1, const Sample &m1, const Sample &k2, const Sample &m2, const float &time, Sample &out) {
+			const float dt = k2.time - k1.time;
+			const float s = dt > 0.f ? (time - k1.time) / dt : 0.f, s2 = s * s, s3 = s2 * s;
+			const float h00 = 2.f * s3 - 3.f * s2 + 1.f, h10 = (s3 - 2.f * s2 + s) * dt, h01 = -2.f * s3 + 3.f * s2, h11 = (s3 - s2) * dt;
+			out.time = time;
+			for (int j = 0; j < 3; j++) {
+				out.translation[j] = h00 * k1.translation[j] + h10 * m1.translation[j] + h01 * k2.translation[j] + h11 * m2.translation[j];
+				out.scale[j] = h00 * k1.scale[j] + h10 * m1.scale[j] + h01 * k2.scale[j] + h11 * m2.scale[j];
+			}
+			float len = 0.f;
+			for (int j = 0; j < 4; j++) {
+				out.rotation[j] = h00 * k1.rotation[j] + h10 * m1.rotation[j] + h01 * k2.rotation[j] + h11 * m2.rotation[j];
+				len += out.rotation[j] * out.rotation[j];
+			}
+			len = len > 0.f ? 1.f / sqrtf(len) : 0.f;
+			for (int j = 0; j < 4; j++)
+				out.rotation[j] *= len;
+		}
+
+		/** Check the cubic segment between the samples first and end, using the tangents estimated from the samples within the segment,
+		 * at each sample and halfway between the samples (where the samples are assumed to be linear).
+		 * Returns the sample to split the segment at, or -1 if it's within the tolerance. */
+		int getCubicSegmentError(const std::vector<Sample> &samples, const int &first, const int &end, const bool &translate, const bool &rotate, const bool &scale) const {
+			if (end - first < 2)
+				return -1;
+			Sample m1, m2, curve, actual;
+			getTangent(samples, first, end, m1);
+			getTangent(samples, end, first, m2);
+			float maxError = 1.f;
+			int index = -1;
+			for (int i = first; i < end; i++) {
+				const Sample &k1 = samples[i], &k2 = samples[i + 1];
+				if (i > first) {
+					hermite(samples[first], m1, samples[end], m2, k1.time, curve);
+					const float error = getKeyframeError(curve, k1, curve, 0.f, translate, rotate, scale);
+					if (error > maxError) {
+						maxError = error;
+						index = i;
 					}
 				}
-				if (last > 0)
-					anim->scaling.push_back(scalingKeyFrames[last]);
+				actual.time = 0.5f * (k1.time + k2.time);
+				for (int j = 0; j < 3; j++) {
+					actual.translation[j] = 0.5f * (k1.translation[j] + k2.translation[j]);
+					actual.scale[j] = 0.5f * (k1.scale[j] + k2.scale[j]);
+				}
+				slerp(actual.rotation, k1.rotation, k2.rotation, 0.5f);
+				hermite(samples[first], m1, samples[end], m2, actual.time, curve);
+				const float error = getKeyframeError(curve, actual, curve, 0.f, translate, rotate, scale);
+				if (error > maxError) {
+					maxError = error;
+					index = i > first ? i : i + 1;
+				}
+			}
+			return index;
+		}
+
+		/** Add the kept samples to the track, for cubic animations along with the tangents of the segments before and after it. */
+		template<int n> void addTrack(Keyframes<n> &track, const std::vector<Sample> &samples, const std::vector<bool> &keep, float (Sample::*value)[n]) const {
+			track.reserve(std::count(keep.begin(), keep.end(), true), settings->cubicAnimations);
+			if (!settings->cubicAnimations) {
+				for (unsigned int i = 0; i < samples.size(); i++)
+					if (keep[i])
+						track.add(samples[i].time, samples[i].*value);
+				return;
+			}
+			Sample in = Sample(), out = Sample();
+			const int count = (int)samples.size();
+			for (int i = 0, prev = -1; i < count; i++) {
+				if (!keep[i])
+					continue;
+				int next = i + 1;
+				while (next < count && !keep[next])
+					next++;
+				// The first and last key use the same tangent on both sides
+				if (next < count)
+					getTangent(samples, i, next, out);
+				if (prev >= 0)
+					getTangent(samples, i, prev, in);
+				else
+					in = out;
+				if (next >= count)
+					out = in;
+				track.add(samples[i].time, samples[i].*value, in.*value, out.*value);
+				prev = i;
 			}
 		}
 	};
 
+	const unsigned int FbxAnimation::SampleStride;
 } }
 
-#endif //FBXCONV_READERS_FBXANIMATION_H
\ No newline at end of file
+#endif //FBXCONV_READERS_FBXANIMATION_H
@@ -25,9 +25,15 @@
 #include "Reader.h"
 #include <sstream>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <thread>
+#include <atomic>
 #include "util.h"
 #include "FbxMeshInfo.h"
+#include "FbxAnimation.h"
+#include "FbxVertexAnimation.h"
+#include "meshopt.h"
 #include "../log/log.h"
 
 using namespace fbxconv::modeldata;
@@ -138,11 +144,12 @@ namespace readers {
 			}
 			if (scene)
 				checkNodes();
-			if (scene)
+			// The geometry, materials and textures aren't needed when only converting the animations
+			if (scene && !settings->animationsOnly)
 				prefetchMeshes();
-			if (scene)
+			if (scene && !settings->animationsOnly)
 				fetchMaterials();
-			if (scene)
+			if (scene && !settings->animationsOnly)
 				fetchTextureBounds();
 			return !(scene == 0);
 		}
@@ -177,6 +184,13 @@ namespace readers {
 				log->error(log::eSourceLoadGeneral);
 				return false;
 			}
+			// Only the node ids and the animations, the transforms and the rest is taken from the base model (so -a and -x don't apply)
+			if (settings->animationsOnly) {
+				model->animationsOnly = true;
+				addNode(model);
+				addAnimations(model, scene);
+				return true;
+			}
 			if (textureCallback)
 				textureCallback(textureFiles);
 			for (int i = 0; i < 8; i++) {
@@ -186,18 +200,24 @@ namespace readers {
 			}
 
 			addMesh(model);
+			if (settings->spatialSort || settings->buildClusters)
+				optimizeMeshes(model);
 			addNode(model);
 
 			for (std::vector<Node *>::iterator itr = model->nodes.begin(); itr != model->nodes.end(); ++itr)
 				updateNode(model, *itr);
 
 			for (std::map<std::string, Material *>::iterator it = materialsMap.begin(); it != materialsMap.end(); ++it) {
-				model->materials.push_back(it->second);
+				model->addMaterial(it->second);
 				for (std::vector<Material::Texture *>::iterator tt = it->second->textures.begin(); tt != it->second->textures.end(); ++tt)
 					(*tt)->path = textureFiles[(*tt)->path].path;
 			}
 
 			addAnimations(model, scene);
+			if (!settings->vertexAnimations.empty())
+				FbxVertexAnimation(settings, log, model).bake(scene);
+			if (settings->pruneNodes)
+				pruneNodes(model);
 			return true;
 		}
 
@@ -210,17 +230,14 @@ namespace readers {
 				return;
 			}
 
-			if (model->getNode(node->GetName())) {
+			Node *n = new Node(node->GetName());
+			if (!model->addNode(n, parent)) {
 				log->warning(log::wSourceConvertFbxDuplicateNodeId, node->GetName());
+				delete n;
 				return;
 			}
-			Node *n = new Node(node->GetName());
 			n->source = node;
 			nodeMap[node] = n;
-			if (parent == 0)
-				model->nodes.push_back(n);
-			else
-				parent->children.push_back(n);
 
 			for (int i = 0; i < node->GetChildCount(); i++)
 				addNode(model, n, node->GetChild(i));
@@ -252,6 +269,8 @@ namespace readers {
 									p.first = nodeMap[nodePart->meshPart->sourceBones[k]->GetLink()];
 									getBindPose(node->source, nodePart->meshPart->sourceBones[k], p.second);
 									nodePart->bones.push_back(p);
+									if (settings->inverseBindMatrices)
+										addInverseBindMatrix(nodePart, p.second);
 								}
 								else {
 									log->warning(log::wSourceConvertFbxInvalidBone, node->id.c_str(), nodePart->meshPart->sourceBones[k]->GetLink()->GetName());
@@ -300,6 +319,15 @@ namespace readers {
 			return FbxAMatrix(lT, lR, lS);
 		}
 
+		/** Add the inverse of the bind pose, inverted in double precision. FbxAMatrix is row major with the translation in the
+		 * last row, so its rows are the columns of the (column major) matrix as used by OpenGL. */
+		void addInverseBindMatrix(NodePart * const &nodePart, const FbxAMatrix &bindPose) {
+			const FbxAMatrix inverse = bindPose.Inverse();
+			for (int r = 0; r < 4; r++)
+				for (int c = 0; c < 4; c++)
+					nodePart->inverseBindMatrices.push_back((float)inverse.Get(r, c));
+		}
+
 		void getBindPose(FbxNode * target, FbxCluster *cluster, FbxAMatrix &out) {
 			if (cluster->GetLinkMode() == FbxCluster::eAdditive)
 				log->warning(log::wSourceConvertFbxAdditiveBones, target->GetName());
@@ -337,7 +365,8 @@ namespace readers {
 			if (meshParts.find(meshInfo) != meshParts.end())
 				return;
 
-			Mesh *mesh = findReusableMesh(model, meshInfo->attributes, meshInfo->polyCount * 3);
+			// The morph target indices rely on the vertices not being shared with other meshes
+			Mesh *mesh = meshInfo->blendShapes.empty() ? findReusableMesh(model, meshInfo->attributes, meshInfo->polyCount * 3) : 0;
 			if (mesh == 0) {
 				mesh = new Mesh();
 				model->meshes.push_back(mesh);
@@ -362,27 +391,51 @@ namespace readers {
 				}
 			}
 
-			float *vertex = new float[mesh->vertexSize];
-			unsigned int pidx = 0;
+			meshInfo->cacheVertexData(uvTransforms);
+
+			// Fetch the vertices in chunks of polygons, each chunk can be fetched independently using the polygon offsets. Meshes with
+			// more than one chunk are fetched by workers (started once per mesh) which take the next chunk until all are fetched,
+			// after which the vertices are added to the mesh in order (which keeps the output deterministic)
+			static const unsigned int chunkSize = 4096;
+			const unsigned int chunkCount = (meshInfo->polyCount + chunkSize - 1) / chunkSize;
+			const unsigned int threadCount = std::max(1U, std::min(std::thread::hardware_concurrency(), chunkCount));
+			std::vector<float> vertices(meshInfo->getPolygonVertexIndex(meshInfo->polyCount) * mesh->vertexSize);
+			std::atomic<unsigned int> next(0);
+			const auto fetch = [&]() {
+				for (unsigned int c = next++; c < chunkCount; c = next++) {
+					const unsigned int first = c * chunkSize;
+					const unsigned int count = std::min(chunkSize, meshInfo->polyCount - first);
+					if (meshInfo->getPolygonVertexCount(first, count) > 0)
+						meshInfo->getVertices(&vertices[meshInfo->getPolygonVertexIndex(first) * mesh->vertexSize], first, count);
+				}
+			};
+			std::vector<std::thread> threads;
+			for (unsigned int t = 1; t < threadCount; t++)
+				threads.push_back(std::thread(fetch));
+			fetch();
+			for (std::vector<std::thread>::iterator itr = threads.begin(); itr != threads.end(); ++itr)
+				itr->join();
+
+			// The mesh vertex of each polygon vertex, needed to map the morph targets
+			std::vector<unsigned int> vertexMap(meshInfo->blendShapes.empty() ? 0 : meshInfo->getPolygonVertexIndex(meshInfo->polyCount));
 			for (unsigned int poly = 0; poly < meshInfo->polyCount; poly++) {
-				unsigned int ps = meshInfo->mesh->GetPolygonSize(poly);
-				unsigned int pi = meshInfo->polyPartMap[poly];
-				unsigned int bi = meshInfo->polyPartBonesMap[poly];
-				if (pi >= parts.size() || bi >= parts[pi].size()) {
+				if (!meshInfo->isValidPolygon(poly)) {
+					meshInfo->releaseVertexData();
 					log->warning(log::wSourceConvertFbxInvalidMesh, node->GetName());
-					delete[] vertex;
 					return;
 				}
-				MeshPart * const &part = parts[pi][bi];
-				//Material * const &material = materialsMap[node->GetMaterial(meshInfo->polyPartMap[poly])];
-
-				for (unsigned int i = 0; i < ps; i++) {
-					const unsigned int v = meshInfo->mesh->GetPolygonVertex(poly, i);
-					meshInfo->getVertex(vertex, poly, pidx, v, uvTransforms);
-					part->indices.push_back(mesh->add(vertex));
-					pidx++;
+				MeshPart * const &part = parts[meshInfo->polyPartMap[poly]][meshInfo->polyPartBonesMap[poly]];
+				const unsigned int end = meshInfo->getPolygonVertexIndex(poly + 1);
+				for (unsigned int pidx = meshInfo->getPolygonVertexIndex(poly); pidx < end; pidx++) {
+					part->indices.push_back(mesh->add(&vertices[pidx * mesh->vertexSize]));
+					if (!vertexMap.empty())
+						vertexMap[pidx] = part->indices.back();
 				}
 			}
+			meshInfo->releaseVertexData();
+
+			if (!vertexMap.empty())
+				addMorphTargets(mesh, meshInfo, vertexMap);
 
 			int idx = 0;
 			for (int i = parts.size() - 1; i >= 0; --i) {
@@ -401,13 +454,133 @@ namespace readers {
 					}
 				}
 			}
+		}
+
+		/** Add a sparse morph target for each blend shape channel of the mesh, containing only the vertices the target shape
+		 * changes. Polygon vertices which are merged into the same vertex get the delta of the first of them. */
+		void addMorphTargets(Mesh * const &mesh, FbxMeshInfo * const &meshInfo, const std::vector<unsigned int> &vertexMap) {
+			std::vector<bool> done(mesh->vertexCount());
+			float position[3], normal[3];
+			size_t deltaCount = 0;
+			for (std::vector<std::pair<FbxBlendShapeChannel *, FbxShape *> >::const_iterator itr = meshInfo->blendShapes.begin(); itr != meshInfo->blendShapes.end(); ++itr) {
+				MorphTarget *target = new MorphTarget();
+				target->id = meshInfo->id + "_" + itr->first->GetName();
+				target->source = itr->first;
+				done.assign(done.size(), false);
+				for (unsigned int pidx = 0; pidx < vertexMap.size(); pidx++) {
+					const unsigned int &index = vertexMap[pidx];
+					if (done[index])
+						continue;
+					done[index] = true;
+					if (!meshInfo->getShapeDelta(itr->second, pidx, meshInfo->polyVertices[pidx], position, normal))
+						continue;
+					target->indices.push_back(index);
+					target->positions.insert(target->positions.end(), position, position + 3);
+					if (meshInfo->normals)
+						target->normals.insert(target->normals.end(), normal, normal + 3);
+				}
+				deltaCount += target->indices.size();
+				mesh->targets.push_back(target);
+			}
+			log->verbose(log::iSourceConvertFbxMorphTargets, meshInfo->id.c_str(), (int)meshInfo->blendShapes.size(), (int)deltaCount, mesh->vertexCount());
+		}
+
+		/** Sort the triangles of each meshpart spatially and optimize them for the vertex cache and/or split them in clusters. */
+		void optimizeMeshes(Model * const &model) {
+			for (std::vector<Mesh *>::iterator itr = model->meshes.begin(); itr != model->meshes.end(); ++itr) {
+				Mesh * const &mesh = *itr;
+				if (!mesh->attributes.hasPosition() || mesh->vertices.empty())
+					continue;
+				for (std::vector<MeshPart *>::iterator it = mesh->parts.begin(); it != mesh->parts.end(); ++it) {
+					MeshPart * const &part = *it;
+					if (part->primitiveType != PRIMITIVETYPE_TRIANGLES)
+						continue;
+					if (settings->spatialSort)
+						meshopt::optimize(part->indices, &mesh->vertices[0], mesh->vertexSize, mesh->vertexCount());
+					if (settings->buildClusters)
+						meshopt::buildClusters(part->clusters, part->indices, &mesh->vertices[0], mesh->vertexSize, mesh->vertexCount());
+				}
+			}
+		}
+
+		/** Remove the nodes which don't affect any rendered geometry, along with their animations. A node is kept if it (or a descendant)
+		 * has parts, is used as a bone by a part or is whitelisted. */
+		void pruneNodes(Model * const &model) {
+			std::set<const Node *> used, kept;
+			for (std::vector<Node *>::const_iterator itr = model->nodes.begin(); itr != model->nodes.end(); ++itr)
+				markUsedNodes(*itr, used);
+			const size_t nodeCount = countNodes(model->nodes);
+			pruneNodes(model->nodes, used, kept);
+			model->updateIndex();
+
+			size_t nodeAnimCount = 0;
+			for (std::vector<Animation *>::iterator itr = model->animations.begin(); itr != model->animations.end();) {
+				std::vector<NodeAnimation *> &nodeAnims = (*itr)->nodeAnimations;
+				nodeAnimCount += pruneNodeAnimations(nodeAnims, kept);
+				// With -r the channels of the removed node animations are still in the resampled frames
+				FbxAnimation::compactFixedRate(*itr);
+				for (std::vector<Animation *>::iterator ct = (*itr)->chunks.begin(); ct != (*itr)->chunks.end(); ++ct)
+					pruneNodeAnimations((*ct)->nodeAnimations, kept);
+				if (!nodeAnims.empty())
+					++itr;
+				else {
+					delete *itr;
+					itr = model->animations.erase(itr);
+				}
+			}
+			log->verbose(log::iSourceConvertFbxPrunedNodes, (int)(nodeCount - kept.size()), (int)nodeAnimCount);
+		}
+
+		/** Remove the node animations of the nodes which aren't kept, returns the number of removed node animations. */
+		static size_t pruneNodeAnimations(std::vector<NodeAnimation *> &nodeAnims, const std::set<const Node *> &kept) {
+			size_t result = 0;
+			for (std::vector<NodeAnimation *>::iterator it = nodeAnims.begin(); it != nodeAnims.end();) {
+				if (kept.find((*it)->node) != kept.end())
+					++it;
+				else {
+					delete *it;
+					it = nodeAnims.erase(it);
+					result++;
+				}
+			}
+			return result;
+		}
+
+		void markUsedNodes(const Node * const &node, std::set<const Node *> &used) {
+			if (!node->parts.empty() || std::find(settings->keepNodes.begin(), settings->keepNodes.end(), node->id) != settings->keepNodes.end())
+				used.insert(node);
+			for (std::vector<NodePart *>::const_iterator itr = node->parts.begin(); itr != node->parts.end(); ++itr)
+				for (std::vector<std::pair<Node *, FbxAMatrix> >::const_iterator it = (*itr)->bones.begin(); it != (*itr)->bones.end(); ++it)
+					used.insert(it->first);
+			for (std::vector<Node *>::const_iterator itr = node->children.begin(); itr != node->children.end(); ++itr)
+				markUsedNodes(*itr, used);
+		}
+
+		/** Remove the nodes which aren't used and don't have any used descendant, returns true if any of the nodes is kept. */
+		bool pruneNodes(std::vector<Node *> &nodes, const std::set<const Node *> &used, std::set<const Node *> &kept) {
+			for (std::vector<Node *>::iterator itr = nodes.begin(); itr != nodes.end();) {
+				if (pruneNodes((*itr)->children, used, kept) || used.find(*itr) != used.end()) {
+					kept.insert(*itr);
+					++itr;
+				}
+				else {
+					delete *itr;
+					itr = nodes.erase(itr);
+				}
+			}
+			return !nodes.empty();
+		}
 
-			delete[] vertex;
+		static size_t countNodes(const std::vector<Node *> &nodes) {
+			size_t result = nodes.size();
+			for (std::vector<Node *>::const_iterator itr = nodes.begin(); itr != nodes.end(); ++itr)
+				result += (*itr)->getTotalNodeCount();
+			return result;
 		}
 
 		Mesh *findReusableMesh(Model * const &model, const Attributes &attributes, const unsigned int &vertexCount) {
 			for (std::vector<Mesh *>::iterator itr = model->meshes.begin(); itr != model->meshes.end(); ++itr)
-				if ((*itr)->attributes == attributes && 
+				if ((*itr)->attributes == attributes && (*itr)->targets.empty() &&
 					((*itr)->vertices.size() / (*itr)->vertexSize) + vertexCount <= settings->maxVertexCount && 
 					(*itr)->indexCount() + vertexCount <= settings->maxIndexCount)
 					return (*itr);
@@ -425,7 +598,7 @@ namespace readers {
 			if (fbxMeshMap.find(geometry) == fbxMeshMap.end())
 				return;
 			FbxMeshInfo *meshInfo = fbxMeshMap[geometry];
-			const int matCount = node->GetMaterialCount();
+			const int matCount = std::min(node->GetMaterialCount(), meshInfo->meshPartCount);
 			for (int i = 0; i < matCount; i++) {
 				FbxSurfaceMaterial *material = node->GetMaterial(i);
 				Material *mat = getMaterial(material->GetName());
@@ -435,6 +608,8 @@ namespace readers {
 					for (unsigned int k = 0; k < meshInfo->uvCount; k++) {
 						if (meshInfo->uvMapping[k] == texture->UVSet.Get().Buffer()) {
 							const int idx = 4 * (i * meshInfo->uvCount + k);
+							if (meshInfo->partUVBounds[idx] > meshInfo->partUVBounds[idx+2])
+								break; // the part doesn't contain any uvs
 							if (*(int*)&info.bounds[0] == -1 || meshInfo->partUVBounds[idx] < info.bounds[0])
 								info.bounds[0] = meshInfo->partUVBounds[idx];
 							if (*(int*)&info.bounds[1] == -1 || meshInfo->partUVBounds[idx+1] < info.bounds[1])
@@ -507,7 +682,7 @@ namespace readers {
 						log->error(log::wSourceConvertFbxNoMaterial, getGeometryName(mesh));
 						continue;
 					}
-					FbxMeshInfo * const info = new FbxMeshInfo(log, mesh, settings->packColors, settings->maxVertexBonesCount, settings->forceMaxVertexBoneCount, settings->maxNodePartBonesCount);
+					FbxMeshInfo * const info = new FbxMeshInfo(log, mesh, settings->packColors, settings->maxVertexBonesCount, settings->forceMaxVertexBoneCount, settings->maxNodePartBonesCount, settings->morphTargets);
 					meshInfos.push_back(info);
 					fbxMeshMap[mesh] = info;
 					if (info->bonesOverflow)
@@ -640,193 +815,86 @@ namespace readers {
 		}
 
 		/** Add the animations if any */
-		void addAnimations(Model * const &model, const FbxScene * const &source) {
+		void addAnimations(Model * const &model, FbxScene * const &source) {
 			const unsigned int animCount = source->GetSrcObjectCount<FbxAnimStack>();
-			for (unsigned int i = 0; i < animCount; i++)
-				addAnimation(model, source->GetSrcObject<FbxAnimStack>(i));
-		}
-
-		/** Add the specified animation to the model */
-		void addAnimation(Model *const &model, FbxAnimStack * const &animStack) {
-			static std::vector<Keyframe *> frames;
-			static std::map<FbxNode *, AnimInfo> affectedNodes;
-			affectedNodes.clear();
-
-			FbxTimeSpan animTimeSpan = animStack->GetLocalTimeSpan();
-			float animStart = (float)(animTimeSpan.GetStart().GetMilliSeconds());
-			float animStop = (float)(animTimeSpan.GetStop().GetMilliSeconds());
-			if (animStop <= animStart)
-				animStop = 999999999.0f;
-
-			// Could also use animStack->GetLocalTimeSpan and animStack->BakeLayers, but its not guaranteed to be correct
-			const int layerCount = animStack->GetMemberCount<FbxAnimLayer>();
-			for (int l = 0; l < layerCount; l++) {
-				FbxAnimLayer *layer = animStack->GetMember<FbxAnimLayer>(l);
-				// For each layer check which node is affected and within what time frame and rate
-				const int curveNodeCount = layer->GetSrcObjectCount<FbxAnimCurveNode>();
-				for (int n = 0; n < curveNodeCount; n++) {
-					FbxAnimCurveNode *curveNode = layer->GetSrcObject<FbxAnimCurveNode>(n);
-					// Check which properties on this curve are changed
-					const int nc = curveNode->GetDstPropertyCount();
-					for (int o = 0; o < nc; o++) {
-						FbxProperty prop = curveNode->GetDstProperty(o);
-						FbxNode *node = static_cast<FbxNode *>(prop.GetFbxObject());
-						if (node) {
-							FbxString propName = prop.GetName();
-							if ( propName == "DeformPercent" )
-							{
-								// When using this propName in model an unhandled exception is launched in sentence node->LclTranslation.GetName()
-								log->warning(log::wSourceConvertFbxSkipPropname, animStack->GetName(), (const char *)propName);
-								continue;
-							}
-
-							// Only add translation, scaling or rotation
-							if ((!node->LclTranslation.IsValid() || propName != node->LclTranslation.GetName()) && 
-								(!node->LclScaling.IsValid() || propName != node->LclScaling.GetName()) &&
-								(!node->LclRotation.IsValid() || propName != node->LclRotation.GetName()))
-								continue;
-							FbxAnimCurve *curve;
-							AnimInfo ts;
-							ts.translate = propName == node->LclTranslation.GetName();
-							ts.rotate = propName == node->LclRotation.GetName();
-							ts.scale = propName == node->LclScaling.GetName();
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_X))
-								updateAnimTime(curve, ts, animStart, animStop);
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Y))
-								updateAnimTime(curve, ts, animStart, animStop);
-							if (curve = prop.GetCurve(layer, FBXSDK_CURVENODE_COMPONENT_Z))
-								updateAnimTime(curve, ts, animStart, animStop);
-							//if (ts.start < ts.stop)
-								affectedNodes[node] += ts;
-						}
-					}
-				}
+			unsigned int threadCount = settings->animationThreads > 0 ? settings->animationThreads : std::thread::hardware_concurrency();
+			threadCount = std::min(std::max(threadCount, 1u), animCount);
+			std::vector<Animation *> animations(animCount, (Animation *)0);
+			if (threadCount > 1 && !addAnimations(model, source, animations, threadCount)) {
+				log->warning(log::wSourceConvertFbxAnimationSceneCopy);
+				threadCount = 1;
 			}
-
-			if (affectedNodes.empty())
-				return;
-
-			Animation *animation = new Animation();
-			model->animations.push_back(animation);
-			animation->id = animStack->GetName();
-			animStack->GetScene()->SetCurrentAnimationStack(animStack);
-
-			// Add the NodeAnimations to the Animation
-			for (std::map<FbxNode *, AnimInfo>::const_iterator itr = affectedNodes.begin(); itr != affectedNodes.end(); itr++) {
-				Node *node = model->getNode((*itr).first->GetName());
-				if (!node)
-					continue;
-				frames.clear();
-				NodeAnimation *nodeAnim = new NodeAnimation();
-				nodeAnim->node = node;
-				nodeAnim->translate = (*itr).second.translate;
-				nodeAnim->rotate = (*itr).second.rotate;
-				nodeAnim->scale = (*itr).second.scale;
-				const float stepSize = (*itr).second.framerate <= 0.f ? (*itr).second.stop - (*itr).second.start : 1000.f / (*itr).second.framerate;
-				const float last = (*itr).second.stop + stepSize * 0.5f;
-				FbxTime fbxTime;
-				// Calculate all keyframes upfront
-				for (float time = (*itr).second.start; time <= last; time += stepSize) {
-					time = std::min(time, (*itr).second.stop);
-					fbxTime.SetMilliSeconds((FbxLongLong)time);
-					Keyframe *kf = new Keyframe();
-					kf->time = (time - animStart);
-					FbxAMatrix *m = &(*itr).first->EvaluateLocalTransform(fbxTime);
-					FbxVector4 v = m->GetT();
-					kf->translation[0] = (float)v.mData[0];
-					kf->translation[1] = (float)v.mData[1];
-					kf->translation[2] = (float)v.mData[2];
-					FbxQuaternion q = m->GetQ();
-					kf->rotation[0] = (float)q.mData[0];
-					kf->rotation[1] = (float)q.mData[1];
-					kf->rotation[2] = (float)q.mData[2];
-					kf->rotation[3] = (float)q.mData[3];
-					v = m->GetS();
-					kf->scale[0] = (float)v.mData[0];
-					kf->scale[1] = (float)v.mData[1];
-					kf->scale[2] = (float)v.mData[2];
-					frames.push_back(kf);
-				}
-				// Only add keyframes really needed
-				addKeyframes(nodeAnim, frames);
-				if (nodeAnim->rotate || nodeAnim->scale || nodeAnim->translate)
-					animation->nodeAnimations.push_back(nodeAnim);
-				else
-					delete nodeAnim;
-			}
-		}
-
-		inline void updateAnimTime(FbxAnimCurve *const &curve, AnimInfo &ts, const float &animStart, const float &animStop) {
-			FbxTimeSpan fts;
-			curve->GetTimeInterval(fts);
-			const FbxTime start = fts.GetStart();
-			const FbxTime stop = fts.GetStop();
-			ts.start = std::max(animStart, std::min(ts.start, (float)(start.GetMilliSeconds())));
-			ts.stop = std::min(animStop, std::max(ts.stop, (float)stop.GetMilliSeconds()));
-			// Could check the number and type of keys (ie curve->KeyGetInterpolation) to lower the framerate
-			ts.framerate = std::max(ts.framerate, (float)stop.GetFrameRate(FbxTime::eDefaultMode));
-		}
-
-		void addKeyframes(NodeAnimation *const &anim, std::vector<Keyframe *> &keyframes) {
-			bool translate = false, rotate = false, scale = false;
-			// Check which components are actually changed
-			for (std::vector<Keyframe *>::const_iterator itr = keyframes.begin(); itr != keyframes.end(); ++itr) {
-				if (!translate && !cmp(anim->node->transform.translation, (*itr)->translation, 3))
-					translate = true;
-				if (!rotate && !cmp(anim->node->transform.rotation, (*itr)->rotation, 3))
-					rotate = true;
-				if (!scale && !cmp(anim->node->transform.scale, (*itr)->scale, 3))
-					scale = true;
-			}
-			// This allows to only export the values actual needed
-			anim->translate = translate;
-			anim->rotate = rotate;
-			anim->scale = scale;
-			for (std::vector<Keyframe *>::const_iterator itr = keyframes.begin(); itr != keyframes.end(); ++itr) {
-				(*itr)->hasRotation = rotate;
-				(*itr)->hasScale = scale;
-				(*itr)->hasTranslation = translate;
-			}
-
-			if (!keyframes.empty()) {
-				anim->keyframes.push_back(keyframes[0]);
-				const int last = (int)keyframes.size()-1;
-				Keyframe *k1 = keyframes[0], *k2, *k3;
-				for (int i = 1; i < last; i++) {
-					k2 = keyframes[i];
-					k3 = keyframes[i+1];
-					// Check if the middle keyframe can be calculated by information, if so dont add it
-					if ((translate && !isLerp(k1->translation, k1->time, k2->translation, k2->time, k3->translation, k3->time, 3)) ||
-						(rotate && !isLerp(k1->rotation, k1->time, k2->rotation, k2->time, k3->rotation, k3->time, 3)) || // FIXME use slerp for quaternions
-						(scale && !isLerp(k1->scale, k1->time, k2->scale, k2->time, k3->scale, k3->time, 3))) {
-							anim->keyframes.push_back(k2);
-							k1 = k2;
-					} else
-						delete k2;
+			if (threadCount <= 1) {
+				FbxAnimation converter(settings, log, model, nodeMap);
+				for (unsigned int i = 0; i < animCount; i++)
+					animations[i] = converter.convert(source->GetSrcObject<FbxAnimStack>(i));
+			}
+			if (animCount > 0)
+				log->verbose(log::iSourceConvertFbxAnimationThreads, (int)animCount, (int)threadCount);
+			// Keep the order of the stacks
+			for (std::vector<Animation *>::const_iterator it = animations.begin(); it != animations.end(); ++it)
+				if (*it)
+					model->animations.push_back(*it);
+		}
+
+		/** Convert the stacks concurrently, the FBX SDK isn't thread safe so each thread evaluates its own copy of the scene.
+		 * Returns false, without converting anything, if the nodes of a copy can't be matched to the source: the node names
+		 * must be unique and each node must have the same index and the same unique id order in the copy. */
+		bool addAnimations(Model * const &model, FbxScene * const &source, std::vector<Animation *> &animations, const unsigned int &threadCount) {
+			const int nodeCount = source->GetNodeCount();
+			std::set<std::string> names;
+			for (int i = 0; i < nodeCount; i++)
+				if (!names.insert(source->GetNode(i)->GetName()).second)
+					return false;
+			const std::vector<int> order = getNodeOrder(source);
+
+			std::vector<FbxScene *> scenes;
+			std::vector<std::map<const FbxNode *, Node *> > nodeMaps(threadCount);
+			bool valid = true;
+			for (unsigned int t = 0; valid && t < threadCount; t++) {
+				scenes.push_back(FbxScene::Create(manager, ""));
+				scenes[t]->Copy(*source);
+				valid = scenes[t]->GetNodeCount() == nodeCount && (unsigned int)scenes[t]->GetSrcObjectCount<FbxAnimStack>() == animations.size()
+					&& getNodeOrder(scenes[t]) == order;
+				for (int i = 0; valid && i < nodeCount; i++) {
+					valid = strcmp(source->GetNode(i)->GetName(), scenes[t]->GetNode(i)->GetName()) == 0;
+					std::map<const FbxNode *, Node *>::const_iterator it = nodeMap.find(source->GetNode(i));
+					if (it != nodeMap.end())
+						nodeMaps[t][scenes[t]->GetNode(i)] = it->second;
 				}
-				if (last > 0)
-					anim->keyframes.push_back(keyframes[last]);
 			}
-		}
+			if (!valid) {
+				for (std::vector<FbxScene *>::iterator it = scenes.begin(); it != scenes.end(); ++it)
+					(*it)->Destroy();
+				return false;
+			}
 
-		inline bool cmp(const float &v1, const float &v2, const float &epsilon = 0.000001) {
-			const double d = v1 - v2;
-			return ((d < 0.f) ? -d : d) < epsilon;
-		}
+			std::atomic<unsigned int> next(0);
+			std::vector<std::thread> threads;
+			for (unsigned int t = 0; t < threadCount; t++) {
+				threads.push_back(std::thread([&, t]() {
+					FbxAnimation converter(settings, log, model, nodeMaps[t]);
+					for (unsigned int i = next++; i < animations.size(); i = next++)
+						animations[i] = converter.convert(scenes[t]->GetSrcObject<FbxAnimStack>(i));
+				}));
+			}
+			for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+				it->join();
 
-		inline bool cmp(const float *v1, const float *v2, const unsigned int &count) {
-			for (unsigned int i = 0; i < count; i++)
-				if (!cmp(v1[i],v2[i]))
-					return false;
+			for (unsigned int t = 0; t < threadCount; t++)
+				scenes[t]->Destroy();
 			return true;
 		}
 
-		inline bool isLerp(const float *v1, const float &t1, const float *v2, const float &t2, const float *v3, const float &t3, const int size) {
-			const double d = (t2 - t1) / (t3 - t1);
-			for (int i = 0; i < size; i++)
-				if (!cmp(v2[i], v1[i] + d * (v3[i] - v1[i])))
-					return false;
-			return true;
+		/** The node indices of the scene sorted by the unique id of the node, which reflects the order the nodes are created in. */
+		static std::vector<int> getNodeOrder(FbxScene * const &scene) {
+			std::vector<int> result(scene->GetNodeCount());
+			for (int i = 0; i < (int)result.size(); i++)
+				result[i] = i;
+			std::sort(result.begin(), result.end(), [scene](const int &a, const int &b) {
+				return scene->GetNode(a)->GetUniqueID() < scene->GetNode(b)->GetUniqueID();
+			});
+			return result;
 		}
 
 		template<int n> inline static void set(float * const &dest, const FbxDouble * const &source) {
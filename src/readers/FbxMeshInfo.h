@@ -29,6 +29,7 @@
 #include <assert.h>
 #include "util.h"
 #include "matrix3.h"
+#include "simd.h"
 #include "../log/log.h"
 
 using namespace fbxconv::modeldata;
@@ -74,8 +75,14 @@ namespace readers {
 		unsigned int * const polyPartMap;
 		// Mapping between the polygon and the index of its weight bones within its meshpart
 		unsigned int * const polyPartBonesMap;
-		// The UV bounds per part per uv coords
-		float * partUVBounds;
+		// The index of the first polygon vertex of each polygon (polyCount + 1 entries, the last being the total)
+		unsigned int * const polyVertexOffsets;
+		// The control point of each polygon vertex
+		const int * const polyVertices;
+		// The blend shape channels along with the target shape of each at full weight, empty if blend shapes aren't used
+		std::vector<std::pair<FbxBlendShapeChannel *, FbxShape *> > blendShapes;
+		// The UV bounds per part per uv coords (x1, y1, x2, y2)
+		std::vector<float> partUVBounds;
 		// The mapping name of each uv to identify the cooresponding texture
 		std::string uvMapping[8];
 
@@ -99,9 +106,44 @@ namespace readers {
 		const FbxLayerElementArrayTemplate<int> *uvIndices[8];
 		bool uvOnPoint[8];
 
+		/** The data of a layer element array, locked for reading by cacheVertexData. GetAt locks and releases the array on
+		 * each call, which isn't thread safe, so the vertices are fetched from the locked data instead. */
+		template<class T> struct LockedArray {
+			FbxLayerElementArrayTemplate<T> *array;
+			T *data;
+			LockedArray() : array(0), data(0) {}
+			void lock(const FbxLayerElementArrayTemplate<T> * const &arr) {
+				// GetLocked isn't const because it changes the lock state of the array, the data is only read through a read lock
+				array = const_cast<FbxLayerElementArrayTemplate<T> *>(arr);
+				data = (array && array->GetCount() > 0) ? array->GetLocked(FbxLayerElementArray::eReadLock) : 0;
+			}
+			void release() {
+				if (data)
+					array->Release(&data);
+				array = 0;
+				data = 0;
+			}
+			inline const T &operator[](const unsigned int &idx) const {
+				return data[idx];
+			}
+		};
+		LockedArray<FbxVector4> lockedNormals, lockedTangents, lockedBinormals;
+		LockedArray<FbxColor> lockedColors;
+		LockedArray<int> lockedNormalIndices, lockedTangentIndices, lockedBinormalIndices, lockedColorIndices, lockedUVIndices[8];
+
+		// The transformed uvs (two floats per direct array element), see cacheVertexData
+		std::vector<float> uvCache[8];
+		// The packed colors (one per direct array element), see cacheVertexData
+		std::vector<unsigned int> packedColorCache;
+
+		// The material index array of each element material, cached so it's not fetched per polygon
+		std::vector<const FbxLayerElementArrayTemplate<int> *> materialIndices;
+		// Whether the element material applies to all polygons (only the first index is valid)
+		std::vector<bool> materialAllSame;
+
 		fbxconv::log::Log *log;
 
-		FbxMeshInfo(fbxconv::log::Log *log, FbxMesh * const &mesh, const bool &usePackedColors, const unsigned int &maxVertexBlendWeightCount, const bool &forceMaxVertexBlendWeightCount, const unsigned int &maxNodePartBoneCount)
+		FbxMeshInfo(fbxconv::log::Log *log, FbxMesh * const &mesh, const bool &usePackedColors, const unsigned int &maxVertexBlendWeightCount, const bool &forceMaxVertexBlendWeightCount, const unsigned int &maxNodePartBoneCount, const bool &useBlendShapes)
 			: mesh(mesh), log(log),
 			usePackedColors(usePackedColors),
 			maxVertexBlendWeightCount(maxVertexBlendWeightCount), 
@@ -113,41 +155,64 @@ namespace readers {
 			elementMaterialCount(mesh->GetElementMaterialCount()),
 			uvCount((unsigned int)(mesh->GetElementUVCount() > 8 ? 8 : mesh->GetElementUVCount())),
 			pointBlendWeights(0),
+			meshPartCount(0),
 			skin((maxNodePartBoneCount > 0 && maxVertexBlendWeightCount > 0 && (unsigned int)mesh->GetDeformerCount(FbxDeformer::eSkin) > 0) ? static_cast<FbxSkin*>(mesh->GetDeformer(0, FbxDeformer::eSkin)) : 0),
 			bonesOverflow(false),
 			polyPartMap(polyCount > 0 ? new unsigned int[polyCount] : 0),
 			polyPartBonesMap(polyCount > 0 ? new unsigned int[polyCount] : 0),
+			polyVertexOffsets(new unsigned int[polyCount + 1]),
+			polyVertices(mesh->GetPolygonVertices()),
 			id(getID(mesh))
 		{
-			meshPartCount = calcMeshPartCount();
-			partBones = std::vector<BlendBonesCollection>(meshPartCount, BlendBonesCollection(maxNodePartBoneCount));
-			partUVBounds = meshPartCount * uvCount > 0 ? new float[4 * meshPartCount * uvCount] : 0;
 			memset(polyPartMap, -1, sizeof(unsigned int) * polyCount);
 			memset(polyPartBonesMap, 0, sizeof(unsigned int) * polyCount);
-			if (partUVBounds)
-				memset(partUVBounds, -1, sizeof(float) * 4 * meshPartCount * uvCount);
+			polyVertexOffsets[0] = 0;
+			for (unsigned int poly = 0; poly < polyCount; poly++)
+				polyVertexOffsets[poly + 1] = polyVertexOffsets[poly] + (unsigned int)mesh->GetPolygonSize(poly);
 
-			if (skin) {
+			if (skin)
 				fetchVertexBlendWeights();
-				fetchMeshPartsAndBones();
-			}
-			else
-				fetchMeshParts();
+			if (useBlendShapes)
+				fetchBlendShapes();
 
 			fetchAttributes();
 			cacheAttributes();
+			cacheMaterials();
 			fetchUVInfo();
+			analyze(maxNodePartBoneCount);
 		}
 
 		~FbxMeshInfo() {
+			releaseVertexData();
 			if (pointBlendWeights)
 				delete[] pointBlendWeights;
 			if (polyPartMap)
 				delete[] polyPartMap;
 			if (polyPartBonesMap)
 				delete[] polyPartBonesMap;
-			if (partUVBounds)
-				delete[] partUVBounds;
+			delete[] polyVertexOffsets;
+		}
+
+		/** The index of the first polygon vertex of the polygon, like FbxMesh::GetPolygonVertexIndex */
+		inline unsigned int getPolygonVertexIndex(const unsigned int &poly) const {
+			return polyVertexOffsets[poly];
+		}
+
+		inline unsigned int getPolygonSize(const unsigned int &poly) const {
+			return polyVertexOffsets[poly + 1] - polyVertexOffsets[poly];
+		}
+
+		/** The number of polygon vertices of the polygons [first, first + count) */
+		inline unsigned int getPolygonVertexCount(const unsigned int &first, const unsigned int &count) const {
+			return polyVertexOffsets[first + count] - polyVertexOffsets[first];
+		}
+
+		inline unsigned int getPolygonVertex(const unsigned int &poly, const unsigned int &index) const {
+			return (unsigned int)polyVertices[polyVertexOffsets[poly] + index];
+		}
+
+		inline bool isValidPolygon(const unsigned int &poly) const {
+			return polyPartMap[poly] < (unsigned int)meshPartCount && polyPartBonesMap[poly] < std::max(1U, partBones[polyPartMap[poly]].size());
 		}
 
 		inline FbxCluster *getBone(const unsigned int &idx) {
@@ -166,12 +231,43 @@ namespace readers {
 			//return normalOnPoint ? (*normals)[normalIndices ? (*normalIndices)[point] : point] : (*normals)[normalIndices ? (*normalIndices)[polyIndex]: polyIndex];
 		}
 
+		/** Requires cacheVertexData to be called first */
 		inline void getNormal(float * const &data, unsigned int &offset, const unsigned int &polyIndex, const unsigned int &point) const {
-			static FbxVector4 tmpV4;
-			getNormal(&tmpV4, polyIndex, point);
-			data[offset++] = (float)tmpV4.mData[0];
-			data[offset++] = (float)tmpV4.mData[1];
-			data[offset++] = (float)tmpV4.mData[2];
+			const FbxVector4 &v = lockedNormals[getIndex(lockedNormalIndices, normalOnPoint, polyIndex, point)];
+			data[offset++] = (float)v.mData[0];
+			data[offset++] = (float)v.mData[1];
+			data[offset++] = (float)v.mData[2];
+		}
+
+		/** The delta of the position and normal (if the mesh has normals) of the polygon vertex within the target shape,
+		 * returns false if the vertex isn't changed by the shape. */
+		bool getShapeDelta(FbxShape * const &shape, const unsigned int &polyIndex, const unsigned int &point, float * const &position, float * const &normal) const {
+			static const float epsilon = 1e-6f;
+			bool changed = false;
+			const FbxVector4 &target = shape->GetControlPoints()[point];
+			for (int i = 0; i < 3; i++) {
+				position[i] = (float)(target[i] - points[point][i]);
+				changed = changed || fabsf(position[i]) > epsilon;
+			}
+			if (!normals)
+				return changed;
+			const FbxGeometryElementNormal *element = shape->GetElementNormal();
+			if (!element) {
+				normal[0] = normal[1] = normal[2] = 0.f;
+				return changed;
+			}
+			const bool onPoint = element->GetMappingMode() == FbxGeometryElement::eByControlPoint;
+			int index = onPoint ? point : polyIndex;
+			if (element->GetReferenceMode() == FbxGeometryElement::eIndexToDirect)
+				index = element->GetIndexArray()[index];
+			FbxVector4 source;
+			getNormal(&source, polyIndex, point);
+			const FbxVector4 dest = element->GetDirectArray().GetAt(index);
+			for (int i = 0; i < 3; i++) {
+				normal[i] = (float)(dest[i] - source[i]);
+				changed = changed || fabsf(normal[i]) > epsilon;
+			}
+			return changed;
 		}
 
 		inline void getTangent(FbxVector4 * const &out, const unsigned int &polyIndex, const unsigned int &point) const {
@@ -179,12 +275,12 @@ namespace readers {
 			//return tangentOnPoint ? (*tangents)[tangentIndices ? (*tangentIndices)[point] : point] : (*tangents)[tangentIndices ? (*tangentIndices)[polyIndex] : polyIndex];
 		}
 
+		/** Requires cacheVertexData to be called first */
 		inline void getTangent(float * const &data, unsigned int &offset, const unsigned int &polyIndex, const unsigned int &point) const {
-			static FbxVector4 tmpV4;
-			getTangent(&tmpV4, polyIndex, point);
-			data[offset++] = (float)tmpV4.mData[0];
-			data[offset++] = (float)tmpV4.mData[1];
-			data[offset++] = (float)tmpV4.mData[2];
+			const FbxVector4 &v = lockedTangents[getIndex(lockedTangentIndices, tangentOnPoint, polyIndex, point)];
+			data[offset++] = (float)v.mData[0];
+			data[offset++] = (float)v.mData[1];
+			data[offset++] = (float)v.mData[2];
 		}
 
 		inline void getBinormal(FbxVector4* const &out, const unsigned int &polyIndex, const unsigned int &point) const {
@@ -192,12 +288,12 @@ namespace readers {
 			//return binormalOnPoint ? (*binormals)[binormalIndices ? (*binormalIndices)[point] : point] : (*binormals)[binormalIndices ? (*binormalIndices)[polyIndex] : polyIndex];
 		}
 
+		/** Requires cacheVertexData to be called first */
 		inline void getBinormal(float * const &data, unsigned int &offset, const unsigned int &polyIndex, const unsigned int &point) const {
-			static FbxVector4 tmpV4;
-			getBinormal(&tmpV4, polyIndex, point);
-			data[offset++] = (float)tmpV4.mData[0];
-			data[offset++] = (float)tmpV4.mData[1];
-			data[offset++] = (float)tmpV4.mData[2];
+			const FbxVector4 &v = lockedBinormals[getIndex(lockedBinormalIndices, binormalOnPoint, polyIndex, point)];
+			data[offset++] = (float)v.mData[0];
+			data[offset++] = (float)v.mData[1];
+			data[offset++] = (float)v.mData[2];
 		}
 
 		inline void getColor(FbxColor * const &out, const unsigned int &polyIndex, const unsigned int &point) const {
@@ -205,33 +301,33 @@ namespace readers {
 			//return colorOnPoint ? (*colors)[colorIndices ? (*colorIndices)[point] : point] : (*colors)[colorIndices ? (*colorIndices)[polyIndex] : polyIndex];
 		}
 
+		/** Requires cacheVertexData to be called first */
 		inline void getColor(float * const &data, unsigned int &offset, const unsigned int &polyIndex, const unsigned int &point) const {
-			static FbxColor tmpC;
-			getColor(&tmpC, polyIndex, point);
-			data[offset++] = (float)tmpC.mRed;
-			data[offset++] = (float)tmpC.mGreen;
-			data[offset++] = (float)tmpC.mBlue;
-			data[offset++] = (float)tmpC.mAlpha;
+			const FbxColor &c = lockedColors[getIndex(lockedColorIndices, colorOnPoint, polyIndex, point)];
+			data[offset++] = (float)c.mRed;
+			data[offset++] = (float)c.mGreen;
+			data[offset++] = (float)c.mBlue;
+			data[offset++] = (float)c.mAlpha;
 		}
 
+		/** Requires cacheVertexData to be called first */
 		inline void getColorPacked(float * const &data, unsigned int &offset, const unsigned int &polyIndex, const unsigned int &point) const {
-			static FbxColor tmpC;
-			getColor(&tmpC, polyIndex, point);
-			unsigned int packedColor = ((unsigned int)(255.*tmpC.mAlpha)<<24) | ((unsigned int)(255.*tmpC.mBlue)<<16) | ((unsigned int)(255.*tmpC.mGreen)<<8) | ((unsigned int)(255.*tmpC.mRed));
-			data[offset++] = *(float*)&packedColor;
+			data[offset++] = simd::packedColorToFloat(packedColorCache[getIndex(lockedColorIndices, colorOnPoint, polyIndex, point)]);
+		}
+
+		inline unsigned int getUVIndex(const unsigned int &uvIndex, const unsigned int &polyIndex, const unsigned int &point) const {
+			return uvOnPoint[uvIndex] ? (uvIndices[uvIndex] ? (*uvIndices[uvIndex])[point] : point) : (uvIndices[uvIndex] ? (*uvIndices[uvIndex])[polyIndex] : polyIndex);
 		}
 
 		inline void getUV(FbxVector2 * const &out, const unsigned int &uvIndex, const unsigned int &polyIndex, const unsigned int &point) const {
-			((FbxLayerElementArray*)uvs[uvIndex])->GetAt(uvOnPoint[uvIndex] ? (uvIndices[uvIndex] ? (*uvIndices[uvIndex])[point] : point) : (uvIndices[uvIndex] ? (*uvIndices[uvIndex])[polyIndex] : polyIndex), out);
-			//return uvOnPoint[uvIndex] ? (*uvs[uvIndex]).GetAt(uvIndices[uvIndex] ? (*uvIndices[uvIndex])[point] : point) : (*uvs[uvIndex]).GetAt(uvIndices[uvIndex] ? (*uvIndices[uvIndex])[polyIndex] : polyIndex);
+			((FbxLayerElementArray*)uvs[uvIndex])->GetAt(getUVIndex(uvIndex, polyIndex, point), out);
 		}
 
-		inline void getUV(float * const &data, unsigned int &offset, const unsigned int &uvIndex, const unsigned int &polyIndex, const unsigned int &point, const Matrix3<float> &transform) const {
-			static FbxVector2 uv;
-			getUV(&uv, uvIndex, polyIndex, point);
-			data[offset++] = (float)uv.mData[0];
-			data[offset++] = (float)uv.mData[1];
-			transform.transform(data[offset-2], data[offset-1]);
+		/** Requires cacheVertexData to be called first */
+		inline void getUV(float * const &data, unsigned int &offset, const unsigned int &uvIndex, const unsigned int &polyIndex, const unsigned int &point) const {
+			const float * const uv = &uvCache[uvIndex][2 * getIndex(lockedUVIndices[uvIndex], uvOnPoint[uvIndex], polyIndex, point)];
+			data[offset++] = uv[0];
+			data[offset++] = uv[1];
 		}
 
 		inline void getBlendWeight(float * const &data, unsigned int &offset, const unsigned int &weightIndex, const unsigned int &poly, const unsigned int &polyIndex, const unsigned int &point) const {
@@ -242,7 +338,7 @@ namespace readers {
 			data[offset++] = weightIndex < s ? weights[weightIndex].weight : 0.f;
 		}
 
-		inline void getVertex(float * const &data, unsigned int &offset, const unsigned int &poly, const unsigned int &polyIndex, const unsigned int &point, const Matrix3<float> * const &uvTransforms) const {
+		inline void getVertex(float * const &data, unsigned int &offset, const unsigned int &poly, const unsigned int &polyIndex, const unsigned int &point) const {
 			if (attributes.hasPosition())
 				getPosition(data, offset, point);
 			if (attributes.hasNormal())
@@ -256,14 +352,85 @@ namespace readers {
 			if (attributes.hasBinormal())
 				getBinormal(data, offset, polyIndex, point);
 			for (unsigned int i = 0; i < uvCount; i++)
-				getUV(data, offset, i, polyIndex, point, uvTransforms[i]);
+				getUV(data, offset, i, polyIndex, point);
 			for (unsigned int i = 0; i < vertexBlendWeightCount; i++)
 				getBlendWeight(data, offset, i, poly, polyIndex, point);
 		}
 
-		inline void getVertex(float * const &data, const unsigned int &poly, const unsigned int &polyIndex, const unsigned int &point, const Matrix3<float> * const &uvTransforms) const {
+		inline void getVertex(float * const &data, const unsigned int &poly, const unsigned int &polyIndex, const unsigned int &point) const {
 			unsigned int offset = 0;
-			getVertex(data, offset, poly, polyIndex, point, uvTransforms);
+			getVertex(data, offset, poly, polyIndex, point);
+		}
+
+		/** The index within the direct array of a layer element, using the locked index array if the element is indexed. */
+		inline static unsigned int getIndex(const LockedArray<int> &indices, const bool &onPoint, const unsigned int &polyIndex, const unsigned int &point) {
+			const unsigned int idx = onPoint ? point : polyIndex;
+			return indices.data ? (unsigned int)indices[idx] : idx;
+		}
+
+		/** Transform all uvs, pack all colors and lock the other layer elements of the mesh at once, must be called before fetching
+		 * any vertices. Afterwards the vertices can be fetched concurrently, until releaseVertexData is called. */
+		void cacheVertexData(const Matrix3<float> * const &uvTransforms) {
+			releaseVertexData();
+			lockedNormals.lock(normals);
+			lockedNormalIndices.lock(normalIndices);
+			lockedTangents.lock(tangents);
+			lockedTangentIndices.lock(tangentIndices);
+			lockedBinormals.lock(binormals);
+			lockedBinormalIndices.lock(binormalIndices);
+			if (attributes.hasColor())
+				lockedColors.lock(colors);
+			lockedColorIndices.lock(colorIndices);
+			for (unsigned int i = 0; i < uvCount; i++)
+				lockedUVIndices[i].lock(uvIndices[i]);
+			for (unsigned int i = 0; i < uvCount; i++) {
+				FbxLayerElementArrayTemplate<FbxVector2> * const arr = const_cast<FbxLayerElementArrayTemplate<FbxVector2> *>(uvs[i]);
+				const unsigned int count = (unsigned int)arr->GetCount();
+				uvCache[i].resize(2 * count);
+				if (count == 0)
+					continue;
+				FbxVector2 *data = arr->GetLocked(FbxLayerElementArray::eReadLock);
+				simd::transformUVs(uvTransforms[i], (const double *)data, &uvCache[i][0], count);
+				arr->Release(&data);
+			}
+			if (attributes.hasColorPacked()) {
+				FbxLayerElementArrayTemplate<FbxColor> * const arr = const_cast<FbxLayerElementArrayTemplate<FbxColor> *>(colors);
+				const unsigned int count = (unsigned int)arr->GetCount();
+				packedColorCache.resize(count);
+				if (count > 0) {
+					FbxColor *data = arr->GetLocked(FbxLayerElementArray::eReadLock);
+					simd::packColors((const double *)data, &packedColorCache[0], count);
+					arr->Release(&data);
+				}
+			}
+		}
+
+		/** Release the layer elements locked by cacheVertexData. */
+		void releaseVertexData() {
+			lockedNormals.release();
+			lockedNormalIndices.release();
+			lockedTangents.release();
+			lockedTangentIndices.release();
+			lockedBinormals.release();
+			lockedBinormalIndices.release();
+			lockedColors.release();
+			lockedColorIndices.release();
+			for (unsigned int i = 0; i < 8; i++)
+				lockedUVIndices[i].release();
+		}
+
+		/** Fetch the vertices of the polygons [first, first + count) into data, starting with the first polygon vertex of the first polygon.
+		 * Polygons without a valid part are skipped (their vertices are left untouched). Only depends on the polygon offsets, so any 
+		 * range of polygons can be fetched independently of the others. Requires cacheVertexData to be called first. */
+		void getVertices(float * const &data, const unsigned int &first, const unsigned int &count) const {
+			const unsigned int vertexSize = attributes.size();
+			const unsigned int base = polyVertexOffsets[first];
+			for (unsigned int poly = first; poly < first + count; poly++) {
+				if (!isValidPolygon(poly))
+					continue;
+				for (unsigned int pidx = polyVertexOffsets[poly]; pidx < polyVertexOffsets[poly + 1]; pidx++)
+					getVertex(&data[(pidx - base) * vertexSize], poly, pidx, (unsigned int)polyVertices[pidx]);
+			}
 		}
 	private:
 		static std::string getID(FbxMesh * const &mesh) {
@@ -277,20 +444,6 @@ namespace readers {
 			return ss.str();
 		}
 		
-		unsigned int calcMeshPartCount() {
-			int mp, mpc = 0;
-			for (unsigned int poly = 0; poly < polyCount; poly++) {
-				mp = -1;
-				for (int i = 0; i < elementMaterialCount && mp < 0; i++)
-					mp = mesh->GetElementMaterial(i)->GetIndexArray()[poly];
-				if (mp >= mpc)
-					mpc = mp+1;
-			}
-			if (mpc == 0)
-				mpc = 1;
-			return mpc;
-		}
-
 		void fetchAttributes() {
 			attributes.hasPosition(true);
 			attributes.hasNormal(mesh->GetElementNormalCount() > 0);
@@ -334,6 +487,22 @@ namespace readers {
 			}
 		}
 
+		void fetchBlendShapes() {
+			const int deformerCount = mesh->GetDeformerCount(FbxDeformer::eBlendShape);
+			for (int i = 0; i < deformerCount; i++) {
+				FbxBlendShape *blendShape = static_cast<FbxBlendShape*>(mesh->GetDeformer(i, FbxDeformer::eBlendShape));
+				const int channelCount = blendShape->GetBlendShapeChannelCount();
+				for (int j = 0; j < channelCount; j++) {
+					FbxBlendShapeChannel *channel = blendShape->GetBlendShapeChannel(j);
+					const int shapeCount = channel->GetTargetShapeCount();
+					// In-between targets aren't supported, only the last (full weight) target is used
+					FbxShape *shape = shapeCount > 0 ? channel->GetTargetShape(shapeCount - 1) : 0;
+					if (shape && (unsigned int)shape->GetControlPointsCount() == pointCount)
+						blendShapes.push_back(std::make_pair(channel, shape));
+				}
+			}
+		}
+
 		void fetchVertexBlendWeights() {
 			pointBlendWeights = new std::vector<BlendWeight>[pointCount];
 			const int &clusterCount = skin->GetClusterCount();
@@ -372,42 +541,116 @@ namespace readers {
 				log->warning(log::wSourceConvertFbxZeroWeights);
 		}
 
-		void fetchMeshPartsAndBones() {
-			std::vector<std::vector<BlendWeight>*> polyWeights;
+		void cacheMaterials() {
+			materialIndices.resize(elementMaterialCount);
+			materialAllSame.resize(elementMaterialCount);
+			for (int i = 0; i < elementMaterialCount; i++) {
+				const FbxGeometryElementMaterial * const element = mesh->GetElementMaterial(i);
+				materialIndices[i] = &(element->GetIndexArray());
+				materialAllSame[i] = element->GetMappingMode() == FbxGeometryElement::eAllSame;
+			}
+		}
+
+		inline int getPolyMaterial(const unsigned int &poly) const {
+			int mp = -1;
+			for (int i = 0; i < elementMaterialCount && mp < 0; i++)
+				mp = (*materialIndices[i])[materialAllSame[i] ? 0 : poly];
+			return mp;
+		}
+
+		inline void addMeshPart(const unsigned int &maxNodePartBoneCount) {
+			partBones.push_back(BlendBonesCollection(maxNodePartBoneCount));
+			for (unsigned int j = 0; j < uvCount; j++) {
+				partUVBounds.push_back(FLT_MAX);
+				partUVBounds.push_back(FLT_MAX);
+				partUVBounds.push_back(-FLT_MAX);
+				partUVBounds.push_back(-FLT_MAX);
+			}
+			meshPartCount++;
+		}
+
+		/** Walk all polygons once: resolve the mesh part of each polygon, partition its bones and update the uv bounds of its part. */
+		void analyze(const unsigned int &maxNodePartBoneCount) {
+			// The distinct bone sets used by the polygons, along with the amount of polygons using each set
+			std::vector<int> polyBones;
+			std::map<std::vector<int>, unsigned int> setIndices;
+			std::vector<std::vector<int> > sets;
+			std::vector<unsigned int> setPolyCounts;
+			std::vector<unsigned int> polySets(skin ? polyCount : 0, 0);
+			FbxVector2 uv;
+			unsigned int idx;
 			for (unsigned int poly = 0; poly < polyCount; poly++) {
-				int mp = -1;
-				for (int i = 0; i < elementMaterialCount && mp < 0; i++)
-					mp = mesh->GetElementMaterial(i)->GetIndexArray()[poly];
-				if (mp < 0 || mp >= meshPartCount) {
-					polyPartMap[poly] = -1;
+				const unsigned int polySize = getPolygonSize(poly);
+				const int mp = getPolyMaterial(poly);
+				if (mp < 0) {
 					log->warning(log::wSourceConvertFbxNoPolyPart, mesh->GetName(), poly);
+					continue;
 				}
-				else {
-					polyPartMap[poly] = mp;
-					const unsigned int polySize = mesh->GetPolygonSize(poly);
-					polyWeights.clear();
-					for (unsigned int i = 0; i < polySize; i++)
-						polyWeights.push_back(&pointBlendWeights[mesh->GetPolygonVertex(poly, i)]);
-					const int sp = partBones[mp].add(polyWeights);
-					polyPartBonesMap[poly] = sp < 0 ? 0 : (unsigned int)sp;
-					if (sp < 0)
-						bonesOverflow = true;
+				while (mp >= meshPartCount)
+					addMeshPart(maxNodePartBoneCount);
+				polyPartMap[poly] = mp;
+
+				if (skin) {
+					polyBones.clear();
+					for (unsigned int i = 0; i < polySize; i++) {
+						const std::vector<BlendWeight> &weights = pointBlendWeights[getPolygonVertex(poly, i)];
+						for (std::vector<BlendWeight>::const_iterator itr = weights.begin(); itr != weights.end(); ++itr)
+							polyBones.push_back(itr->index);
+					}
+					std::sort(polyBones.begin(), polyBones.end());
+					polyBones.erase(std::unique(polyBones.begin(), polyBones.end()), polyBones.end());
+					std::map<std::vector<int>, unsigned int>::iterator it = setIndices.find(polyBones);
+					if (it == setIndices.end()) {
+						it = setIndices.insert(std::make_pair(polyBones, (unsigned int)sets.size())).first;
+						sets.push_back(polyBones);
+						setPolyCounts.push_back(0);
+					}
+					setPolyCounts[it->second]++;
+					polySets[poly] = it->second;
+				}
+
+				for (unsigned int pidx = polyVertexOffsets[poly]; pidx < polyVertexOffsets[poly + 1]; pidx++) {
+					const unsigned int v = (unsigned int)polyVertices[pidx];
+					for (unsigned int j = 0; j < uvCount; j++) {
+						getUV(&uv, j, pidx, v);
+						idx = 4 * (mp * uvCount + j);
+						partUVBounds[idx] = std::min(partUVBounds[idx], (float)uv.mData[0]);
+						partUVBounds[idx+1] = std::min(partUVBounds[idx+1], (float)uv.mData[1]);
+						partUVBounds[idx+2] = std::max(partUVBounds[idx+2], (float)uv.mData[0]);
+						partUVBounds[idx+3] = std::max(partUVBounds[idx+3], (float)uv.mData[1]);
+					}
 				}
 			}
+			if (meshPartCount == 0)
+				addMeshPart(maxNodePartBoneCount);
+			if (skin)
+				partitionBones(maxNodePartBoneCount, sets, setPolyCounts, polySets);
 		}
 
-		void fetchMeshParts() {
-			int mp;
+		/** Partition the bone sets of all polygons at once, so the bones are shared by as many polygons as possible. The groups
+		 * are shared across the mesh parts: a mesh part gets a copy of each group used by its polygons. */
+		void partitionBones(const unsigned int &maxNodePartBoneCount, const std::vector<std::vector<int> > &sets, const std::vector<unsigned int> &setPolyCounts, const std::vector<unsigned int> &polySets) {
+			BlendBonesCollection groups(maxNodePartBoneCount);
+			std::vector<int> setGroups;
+			groups.partition(sets, setPolyCounts, setGroups);
+			// The index of each group within each mesh part, -1 if not used by the part
+			std::vector<int> partGroups(meshPartCount * groups.size(), -1);
 			for (unsigned int poly = 0; poly < polyCount; poly++) {
-				mp = -1;
-				for (int i = 0; i < elementMaterialCount && mp < 0; i++)
-					mp = mesh->GetElementMaterial(i)->GetIndexArray()[poly];
-				if (mp < 0 || mp >= meshPartCount) {
-					polyPartMap[poly] = -1;
-					log->warning(log::wSourceConvertFbxNoPolyPart, mesh->GetName(), poly);
+				const unsigned int mp = polyPartMap[poly];
+				if (mp >= (unsigned int)meshPartCount)
+					continue;
+				const int group = setGroups[polySets[poly]];
+				if (group < 0) {
+					bonesOverflow = true;
+					polyPartBonesMap[poly] = 0;
+					continue;
 				}
-				else
-					polyPartMap[poly] = mp;
+				int &idx = partGroups[mp * groups.size() + group];
+				if (idx < 0) {
+					idx = (int)partBones[mp].size();
+					partBones[mp].bones.push_back(groups[group]);
+				}
+				polyPartBonesMap[poly] = (unsigned int)idx;
 			}
 		}
 
@@ -416,35 +659,6 @@ namespace readers {
 			mesh->GetUVSetNames(uvSetNames);
 			for (unsigned int i = 0; i < uvCount; i++)
 				uvMapping[i] = uvSetNames.GetItemAt(i)->mString.Buffer();
-
-			if (partUVBounds == 0 || uvCount == 0)
-				return;
-			FbxVector2 uv;
-			int mp;
-			unsigned int idx, pidx = 0, v = 0;
-			for (unsigned int poly = 0; poly < polyCount; poly++) {
-				mp = polyPartMap[poly];
-
-				const unsigned int polySize = mesh->GetPolygonSize(poly);
-				for (unsigned int i = 0; i < polySize; i++) {
-					v = mesh->GetPolygonVertex(poly, i);
-					if (mp >= 0) {
-						for (unsigned int j = 0; j < uvCount; j++) {
-							getUV(&uv, j, pidx, v);
-							idx = 4 * (mp * uvCount + j);
-							if (*(int*)&partUVBounds[idx]==-1 || uv.mData[0] < partUVBounds[idx])
-								partUVBounds[idx] = (float)uv.mData[0];
-							if (*(int*)&partUVBounds[idx+1]==-1 || uv.mData[1] < partUVBounds[idx+1])
-								partUVBounds[idx+1] = (float)uv.mData[1];
-							if (*(int*)&partUVBounds[idx+2]==-1 || uv.mData[0] > partUVBounds[idx+2])
-								partUVBounds[idx+2] = (float)uv.mData[0];
-							if (*(int*)&partUVBounds[idx+3]==-1 || uv.mData[1] > partUVBounds[idx+3])
-								partUVBounds[idx+3] = (float)uv.mData[1];
-						}
-					}
-					pidx++;
-				}
-			}
 		}
 	};
 } }
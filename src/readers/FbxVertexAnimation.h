@@ -0,0 +1,323 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif //_MSC_VER
+#ifndef FBXCONV_READERS_FBXVERTEXANIMATION_H
+#define FBXCONV_READERS_FBXVERTEXANIMATION_H
+
+#include <fbxsdk.h>
+#include "../Settings.h"
+#include "../log/log.h"
+#include "../modeldata/Model.h"
+#include "util.h"
+#include "pngwriter.h"
+#include "FbxAnimation.h"
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using namespace fbxconv::modeldata;
+
+namespace fbxconv {
+namespace readers {
+
+	/** Bakes the skinned vertex positions and normals of the meshes at each frame of animation stacks into textures,
+	 * so the animation can be played without skinning (e.g. for many instances). */
+	class FbxVertexAnimation {
+	public:
+		Settings *settings;
+		fbxconv::log::Log *log;
+		Model * const model;
+
+		// The maximum width of the textures, the vertices of a frame wrap to the next row beyond this
+		static const unsigned int MaxWidth = 4096;
+
+		// The node part which is used to transform a vertex, along with the transforms it needs at the current frame
+		struct VertexPart {
+			const Node *node;
+			const NodePart *nodePart;
+			// The global transform of the node followed by the skinning transform of each bone (row major, translation in row 3)
+			std::vector<double> matrices;
+			// The inverse bind pose of each bone
+			std::vector<FbxAMatrix> inverseBindPoses;
+		};
+
+		FbxVertexAnimation(Settings *settings, fbxconv::log::Log *log, Model * const &model)
+			: settings(settings), log(log), model(model) {}
+
+		/** Bake the animation stacks of the settings for each mesh used by a node, the textures are written next to the output file. */
+		void bake(FbxScene * const &scene) {
+			std::vector<FbxAnimStack *> stacks;
+			const int stackCount = scene->GetSrcObjectCount<FbxAnimStack>();
+			for (std::vector<std::string>::const_iterator itr = settings->vertexAnimations.begin(); itr != settings->vertexAnimations.end(); ++itr) {
+				FbxAnimStack *stack = 0;
+				for (int i = 0; i < stackCount && !stack; i++)
+					if (*itr == scene->GetSrcObject<FbxAnimStack>(i)->GetName())
+						stack = scene->GetSrcObject<FbxAnimStack>(i);
+				if (stack)
+					stacks.push_back(stack);
+				else
+					log->warning(log::wSourceConvertFbxVertexAnimationStack, itr->c_str());
+			}
+			if (stacks.empty())
+				return;
+
+			for (unsigned int m = 0; m < model->meshes.size(); m++) {
+				Mesh * const &mesh = model->meshes[m];
+				std::vector<VertexPart> parts;
+				std::vector<int> vertexParts(mesh->vertexCount(), -1);
+				for (std::vector<Node *>::const_iterator itr = model->nodes.begin(); itr != model->nodes.end(); ++itr)
+					addVertexParts(mesh, *itr, parts, vertexParts);
+				if (parts.empty() || !mesh->attributes.hasPosition())
+					continue;
+				unsigned int uv = 0;
+				while (uv < 8 && mesh->attributes.hasUV(uv))
+					uv++;
+				if (uv >= 8) {
+					log->warning(log::wSourceConvertFbxVertexAnimationUV, m);
+					continue;
+				}
+				for (std::vector<FbxAnimStack *>::const_iterator itr = stacks.begin(); itr != stacks.end(); ++itr)
+					bake(mesh, m, *itr, parts, vertexParts, uv);
+				addLookup(mesh, uv);
+			}
+		}
+
+		/** Add the node parts which use the mesh, the first node part referencing a vertex is used to transform it. */
+		void addVertexParts(const Mesh * const &mesh, const Node * const &node, std::vector<VertexPart> &parts, std::vector<int> &vertexParts) {
+			for (std::vector<NodePart *>::const_iterator itr = node->parts.begin(); itr != node->parts.end(); ++itr) {
+				if (std::find(mesh->parts.begin(), mesh->parts.end(), (*itr)->meshPart) == mesh->parts.end())
+					continue;
+				const int index = (int)parts.size();
+				bool used = false;
+				for (std::vector<unsigned short>::const_iterator it = (*itr)->meshPart->indices.begin(); it != (*itr)->meshPart->indices.end(); ++it) {
+					if (vertexParts[*it] < 0) {
+						vertexParts[*it] = index;
+						used = true;
+					}
+				}
+				if (!used)
+					continue;
+				parts.push_back(VertexPart());
+				VertexPart &part = parts.back();
+				part.node = node;
+				part.nodePart = *itr;
+				part.matrices.resize(16 * (1 + (*itr)->bones.size()));
+				for (std::vector<std::pair<Node *, FbxAMatrix> >::const_iterator it = (*itr)->bones.begin(); it != (*itr)->bones.end(); ++it)
+					part.inverseBindPoses.push_back(it->second.Inverse());
+			}
+			for (std::vector<Node *>::const_iterator itr = node->children.begin(); itr != node->children.end(); ++itr)
+				addVertexParts(mesh, *itr, parts, vertexParts);
+		}
+
+		/** Evaluate the vertices at each frame of the stack and write them to a texture. */
+		void bake(Mesh * const &mesh, const unsigned int &meshIndex, FbxAnimStack * const &stack, std::vector<VertexPart> &parts, const std::vector<int> &vertexParts, const unsigned int &uv) {
+			stack->GetScene()->SetCurrentAnimationStack(stack);
+			FbxTimeSpan timeSpan = stack->GetLocalTimeSpan();
+			const FbxLongLong start = timeSpan.GetStart().Get();
+			const double duration = std::max(0.0, FbxTime(timeSpan.GetStop().Get() - start).GetSecondDouble());
+
+			VertexAnimation *result = new VertexAnimation();
+			result->animation = stack->GetName();
+			result->half = !settings->vertexAnimationsRGBA8;
+			result->frameRate = settings->fixedAnimationRate > 0.f ? settings->fixedAnimationRate : FbxAnimation::getFrameRate(stack->GetScene());
+			result->frameCount = (unsigned int)floor(duration * result->frameRate + 0.5) + 1;
+			const unsigned int vertexCount = mesh->vertexCount();
+			result->width = std::min(vertexCount, MaxWidth);
+			result->rowsPerFrame = (vertexCount + result->width - 1) / result->width;
+			result->normalRow = result->frameCount * result->rowsPerFrame;
+			result->height = 2 * result->normalRow;
+			result->uv = uv;
+
+			const unsigned int normalOffset = mesh->attributes.hasNormal() ? mesh->attributes.offset(ATTRIBUTE_NORMAL) : 0;
+			std::vector<unsigned int> weightOffsets;
+			for (unsigned short i = 0; i < 8; i++)
+				if (mesh->attributes.hasBlendWeight(i))
+					weightOffsets.push_back(mesh->attributes.offset(ATTRIBUTE_BLENDWEIGHT0 + i));
+
+			// The position followed by the normal of each vertex, per frame
+			std::vector<float> frames((size_t)result->frameCount * vertexCount * 6, 0.f);
+			for (unsigned int f = 0; f < result->frameCount; f++) {
+				FbxTime time;
+				time.SetSecondDouble((double)f / result->frameRate);
+				time = FbxTime(start + time.Get());
+				for (std::vector<VertexPart>::iterator itr = parts.begin(); itr != parts.end(); ++itr)
+					updateMatrices(*itr, time);
+				for (unsigned int v = 0; v < vertexCount; v++) {
+					if (vertexParts[v] < 0)
+						continue;
+					const VertexPart &part = parts[vertexParts[v]];
+					const float * const vertex = &mesh->vertices[v * mesh->vertexSize];
+					double blended[16] = {0.0};
+					double total = 0.0;
+					for (std::vector<unsigned int>::const_iterator it = weightOffsets.begin(); it != weightOffsets.end(); ++it) {
+						const int bone = (int)vertex[*it];
+						const double weight = vertex[*it + 1];
+						if (weight <= 0.0 || bone < 0 || bone >= (int)part.inverseBindPoses.size())
+							continue;
+						const double * const matrix = &part.matrices[16 * (bone + 1)];
+						for (int i = 0; i < 16; i++)
+							blended[i] += weight * matrix[i];
+						total += weight;
+					}
+					for (int i = 0; total > 0.0 && i < 16; i++)
+						blended[i] /= total;
+					// Vertices without weights follow the node
+					const double * const matrix = total > 0.0 ? blended : &part.matrices[0];
+					float * const out = &frames[((size_t)f * vertexCount + v) * 6];
+					transform(matrix, vertex, 1.0, out);
+					if (mesh->attributes.hasNormal()) {
+						transform(matrix, &vertex[normalOffset], 0.0, &out[3]);
+						const float len = sqrtf(out[3] * out[3] + out[4] * out[4] + out[5] * out[5]);
+						if (len > 0.f)
+							for (int i = 3; i < 6; i++)
+								out[i] /= len;
+					}
+				}
+			}
+
+			std::stringstream ss;
+			ss << "_vat" << meshIndex << "_" << getSafeFileName(result->animation) << ".png";
+			result->file = getBaseName(settings->outFile) + ss.str();
+			const std::string path = getDirectory(settings->outFile) + result->file;
+			if (write(*result, frames, vertexCount, path)) {
+				mesh->vertexAnimations.push_back(result);
+				log->verbose(log::iSourceConvertFbxVertexAnimation, result->animation.c_str(), result->frameCount, vertexCount, result->file.c_str(), result->width, result->height);
+			}
+			else {
+				log->warning(log::wSourceConvertFbxVertexAnimationWrite, path.c_str());
+				delete result;
+			}
+		}
+
+		void updateMatrices(VertexPart &part, const FbxTime &time) {
+			getMatrix(part.node->source->EvaluateGlobalTransform(time), &part.matrices[0]);
+			for (unsigned int i = 0; i < part.inverseBindPoses.size(); i++)
+				getMatrix(part.nodePart->bones[i].first->source->EvaluateGlobalTransform(time) * part.inverseBindPoses[i], &part.matrices[16 * (i + 1)]);
+		}
+
+		inline static void getMatrix(const FbxAMatrix &m, double * const &out) {
+			for (int r = 0; r < 4; r++)
+				for (int c = 0; c < 4; c++)
+					out[r * 4 + c] = m.Get(r, c);
+		}
+
+		/** Transform the vector (w = 1 for a position, 0 for a direction) by the row major matrix. */
+		inline static void transform(const double * const &m, const float * const &v, const double &w, float * const &out) {
+			for (int c = 0; c < 3; c++)
+				out[c] = (float)(v[0] * m[c] + v[1] * m[4 + c] + v[2] * m[8 + c] + w * m[12 + c]);
+		}
+
+		/** Encode the frames as texels and write the texture. */
+		bool write(VertexAnimation &animation, const std::vector<float> &frames, const unsigned int &vertexCount, const std::string &path) {
+			const size_t texelCount = (size_t)animation.width * animation.height;
+			if (animation.half) {
+				std::vector<unsigned short> pixels(texelCount * 4, 0);
+				for (unsigned int f = 0; f < animation.frameCount; f++) {
+					for (unsigned int v = 0; v < vertexCount; v++) {
+						const float * const in = &frames[((size_t)f * vertexCount + v) * 6];
+						unsigned short * const position = &pixels[getTexel(animation, f, v, false) * 4];
+						unsigned short * const normal = &pixels[getTexel(animation, f, v, true) * 4];
+						for (int i = 0; i < 3; i++) {
+							position[i] = toHalf(in[i]);
+							normal[i] = toHalf(in[3 + i]);
+						}
+						position[3] = normal[3] = toHalf(1.f);
+					}
+				}
+				return writePNG(path.c_str(), animation.width, animation.height, 16, &pixels[0]);
+			}
+
+			for (int i = 0; i < 3; i++) {
+				float mn = frames.empty() ? 0.f : frames[i], mx = mn;
+				for (size_t j = i; j < frames.size(); j += 6) {
+					mn = std::min(mn, frames[j]);
+					mx = std::max(mx, frames[j]);
+				}
+				animation.min[i] = mn;
+				animation.range[i] = mx - mn;
+			}
+			std::vector<unsigned char> pixels(texelCount * 4, 0);
+			for (unsigned int f = 0; f < animation.frameCount; f++) {
+				for (unsigned int v = 0; v < vertexCount; v++) {
+					const float * const in = &frames[((size_t)f * vertexCount + v) * 6];
+					unsigned char * const position = &pixels[getTexel(animation, f, v, false) * 4];
+					unsigned char * const normal = &pixels[getTexel(animation, f, v, true) * 4];
+					for (int i = 0; i < 3; i++) {
+						position[i] = animation.range[i] > 0.f ? (unsigned char)floorf((in[i] - animation.min[i]) / animation.range[i] * 255.f + 0.5f) : 0;
+						normal[i] = (unsigned char)floorf((std::max(-1.f, std::min(1.f, in[3 + i])) * 0.5f + 0.5f) * 255.f + 0.5f);
+					}
+					position[3] = normal[3] = 255;
+				}
+			}
+			return writePNG(path.c_str(), animation.width, animation.height, 8, &pixels[0]);
+		}
+
+		inline static size_t getTexel(const VertexAnimation &animation, const unsigned int &frame, const unsigned int &vertex, const bool &normal) {
+			const size_t row = (normal ? animation.normalRow : 0) + frame * animation.rowsPerFrame + vertex / animation.width;
+			return row * animation.width + vertex % animation.width;
+		}
+
+		/** Add the lookup texture coordinates of each vertex to the mesh, which is needed to sample the baked animations. Both are in
+		 * texels (the column and the row within a frame), because the height of the texture differs per animation. */
+		void addLookup(Mesh * const &mesh, const unsigned int &uv) {
+			if (mesh->vertexAnimations.empty())
+				return;
+			const unsigned int width = mesh->vertexAnimations[0]->width;
+			const unsigned int vertexCount = mesh->vertexCount();
+			const unsigned int oldSize = mesh->vertexSize;
+			mesh->attributes.hasUV(uv, true);
+			mesh->vertexSize = mesh->attributes.size();
+			const unsigned int offset = mesh->attributes.offset(ATTRIBUTE_TEXCOORD0 + uv);
+			std::vector<float> vertices(vertexCount * mesh->vertexSize);
+			for (unsigned int v = 0; v < vertexCount; v++) {
+				const float * const src = &mesh->vertices[v * oldSize];
+				float * const dest = &vertices[v * mesh->vertexSize];
+				std::copy(src, src + offset, dest);
+				dest[offset] = (float)(v % width);
+				dest[offset + 1] = (float)(v / width);
+				std::copy(src + offset, src + oldSize, dest + offset + 2);
+			}
+			mesh->vertices.swap(vertices);
+			for (unsigned int v = 0; v < vertexCount; v++)
+				mesh->hashes[v] = mesh->calcHash(&mesh->vertices[v * mesh->vertexSize], mesh->vertexSize);
+		}
+
+		/** The float as half float (IEEE 754 binary16) bits, rounded to nearest. */
+		static unsigned short toHalf(const float &value) {
+			unsigned int bits;
+			memcpy(&bits, &value, sizeof(float));
+			const unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+			const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+			unsigned int mantissa = bits & 0x7fffff;
+			if (exponent <= 0) {
+				if (exponent < -10)
+					return sign;
+				mantissa |= 0x800000;
+				const int shift = 14 - exponent;
+				return (unsigned short)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+			}
+			if (exponent >= 31)
+				return (unsigned short)(sign | 0x7c00);
+			return (unsigned short)((sign | (exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+		}
+	};
+} }
+
+#endif //FBXCONV_READERS_FBXVERTEXANIMATION_H
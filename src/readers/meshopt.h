@@ -0,0 +1,289 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif //_MSC_VER
+#ifndef FBXCONV_READERS_MESHOPT_H
+#define FBXCONV_READERS_MESHOPT_H
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "../modeldata/MeshPart.h"
+
+namespace fbxconv {
+namespace readers {
+namespace meshopt {
+	// The number of triangles in one spatial block, the vertex cache optimization never moves triangles across blocks
+	static const unsigned int blockTriangleCount = 256;
+	// The simulated post transform vertex cache size
+	static const unsigned int vertexCacheSize = 16;
+	// The maximum number of unique vertices and triangles in one cluster
+	static const unsigned int maxClusterVertexCount = 64;
+	static const unsigned int maxClusterTriangleCount = 124;
+
+	/** Spread the lower 10 bits of v so there are two zero bits between each bit. */
+	inline unsigned int expandBits(unsigned int v) {
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	/** The 30 bit morton code of a point within the unit cube. */
+	inline unsigned int morton(const float &x, const float &y, const float &z) {
+		return (expandBits((unsigned int)(x * 1023.f)) << 2) | (expandBits((unsigned int)(y * 1023.f)) << 1) | expandBits((unsigned int)(z * 1023.f));
+	}
+
+	struct MortonTriangle {
+		unsigned int code;
+		unsigned int index;
+		inline bool operator<(const MortonTriangle &rhs) const {
+			return code < rhs.code;
+		}
+	};
+
+	/** Sort the triangles by the morton code of their centroid, the position is expected to be the first three floats of each vertex. */
+	template<class T> void sortTriangles(std::vector<T> &indices, const float * const &vertices, const unsigned int &vertexSize) {
+		const unsigned int triCount = (unsigned int)indices.size() / 3;
+		if (triCount < 2)
+			return;
+		std::vector<float> centroids(triCount * 3);
+		float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		for (unsigned int t = 0; t < triCount; t++) {
+			for (int c = 0; c < 3; c++) {
+				const float v = (vertices[indices[t*3]*vertexSize+c] + vertices[indices[t*3+1]*vertexSize+c] + vertices[indices[t*3+2]*vertexSize+c]) / 3.f;
+				centroids[t*3+c] = v;
+				min[c] = std::min(min[c], v);
+				max[c] = std::max(max[c], v);
+			}
+		}
+		// Use the same scale for each axis, so the blocks are about cubic
+		const float extent = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+		const float scale = extent > 0.f ? 1.f / extent : 0.f;
+		std::vector<MortonTriangle> tris(triCount);
+		for (unsigned int t = 0; t < triCount; t++) {
+			tris[t].code = morton((centroids[t*3]-min[0])*scale, (centroids[t*3+1]-min[1])*scale, (centroids[t*3+2]-min[2])*scale);
+			tris[t].index = t;
+		}
+		std::stable_sort(tris.begin(), tris.end());
+		std::vector<T> sorted(indices.size());
+		for (unsigned int t = 0; t < triCount; t++)
+			for (int i = 0; i < 3; i++)
+				sorted[t*3+i] = indices[tris[t].index*3+i];
+		indices.swap(sorted);
+	}
+
+	/** Reorder count triangles for the post transform vertex cache (Tipsify, Sander et al. 2007).
+	 * The lookup array must be at least the size of the number of vertices and filled with -1, it is restored on return. */
+	template<class T> void optimizeVertexCache(T * const &indices, const unsigned int &count, std::vector<int> &lookup) {
+		if (count == 0)
+			return;
+		// Map the vertices of this range to a compact local index
+		std::vector<unsigned int> verts;
+		std::vector<unsigned int> local(count * 3);
+		for (unsigned int i = 0; i < count * 3; i++) {
+			int &l = lookup[indices[i]];
+			if (l < 0) {
+				l = (int)verts.size();
+				verts.push_back(indices[i]);
+			}
+			local[i] = (unsigned int)l;
+		}
+		const unsigned int vertCount = (unsigned int)verts.size();
+		for (unsigned int i = 0; i < vertCount; i++)
+			lookup[verts[i]] = -1;
+
+		// Vertex to triangle adjacency
+		std::vector<unsigned int> live(vertCount, 0), offsets(vertCount + 1, 0), adjacency(count * 3);
+		for (unsigned int i = 0; i < count * 3; i++)
+			live[local[i]]++;
+		for (unsigned int v = 0; v < vertCount; v++)
+			offsets[v+1] = offsets[v] + live[v];
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < count * 3; i++)
+			adjacency[fill[local[i]]++] = i / 3;
+
+		std::vector<unsigned int> timestamps(vertCount, 0), deadEnd, output;
+		std::vector<bool> emitted(count, false);
+		output.reserve(count);
+		deadEnd.reserve(count * 3);
+		unsigned int time = vertexCacheSize + 1, cursor = 1;
+		int fanning = 0;
+		while (fanning >= 0) {
+			std::vector<unsigned int> candidates;
+			for (unsigned int a = offsets[fanning]; a < offsets[fanning+1]; a++) {
+				const unsigned int t = adjacency[a];
+				if (emitted[t])
+					continue;
+				emitted[t] = true;
+				output.push_back(t);
+				for (int i = 0; i < 3; i++) {
+					const unsigned int v = local[t*3+i];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - timestamps[v] > vertexCacheSize)
+						timestamps[v] = time++;
+				}
+			}
+			// Select the next fanning vertex: prefer one that stays in the cache after emitting its triangles
+			fanning = -1;
+			int best = -1;
+			for (std::vector<unsigned int>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+				if (live[*it] == 0)
+					continue;
+				int priority = 0;
+				if (time - timestamps[*it] + 2 * live[*it] <= vertexCacheSize)
+					priority = (int)(time - timestamps[*it]);
+				if (priority > best) {
+					best = priority;
+					fanning = (int)*it;
+				}
+			}
+			// Dead end: first try recently used vertices, then fall back to the input order
+			while (fanning < 0 && !deadEnd.empty()) {
+				const unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					fanning = (int)v;
+			}
+			while (fanning < 0 && cursor <= vertCount) {
+				if (live[cursor-1] > 0)
+					fanning = (int)(cursor-1);
+				else
+					cursor++;
+			}
+		}
+
+		std::vector<T> result(count * 3);
+		for (unsigned int t = 0; t < count; t++)
+			for (int i = 0; i < 3; i++)
+				result[t*3+i] = indices[output[t]*3+i];
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	/** Sort the triangles spatially and optimize each block of blockTriangleCount triangles for the vertex cache. */
+	template<class T> void optimize(std::vector<T> &indices, const float * const &vertices, const unsigned int &vertexSize, const unsigned int &vertexCount) {
+		sortTriangles(indices, vertices, vertexSize);
+		std::vector<int> lookup(vertexCount, -1);
+		const unsigned int triCount = (unsigned int)indices.size() / 3;
+		for (unsigned int first = 0; first < triCount; first += blockTriangleCount)
+			optimizeVertexCache(&indices[first * 3], std::min(blockTriangleCount, triCount - first), lookup);
+	}
+
+	/** Calculate the bounding sphere (Ritter) and normal cone of the triangles of a cluster. */
+	template<class T> void calculateClusterBounds(modeldata::MeshPart::Cluster &cluster, const T * const &indices, const float * const &vertices, const unsigned int &vertexSize) {
+		const float *p = &vertices[indices[0]*vertexSize];
+		const float *q = p;
+		float d = 0.f;
+		for (unsigned int i = 0; i < cluster.count; i++) {
+			const float *v = &vertices[indices[i]*vertexSize];
+			const float dv = (v[0]-p[0])*(v[0]-p[0]) + (v[1]-p[1])*(v[1]-p[1]) + (v[2]-p[2])*(v[2]-p[2]);
+			if (dv > d) { d = dv; q = v; }
+		}
+		const float *r = q;
+		d = 0.f;
+		for (unsigned int i = 0; i < cluster.count; i++) {
+			const float *v = &vertices[indices[i]*vertexSize];
+			const float dv = (v[0]-q[0])*(v[0]-q[0]) + (v[1]-q[1])*(v[1]-q[1]) + (v[2]-q[2])*(v[2]-q[2]);
+			if (dv > d) { d = dv; r = v; }
+		}
+		float *s = cluster.sphere;
+		for (int c = 0; c < 3; c++)
+			s[c] = (q[c] + r[c]) * 0.5f;
+		s[3] = sqrtf(d) * 0.5f;
+		for (unsigned int i = 0; i < cluster.count; i++) {
+			const float *v = &vertices[indices[i]*vertexSize];
+			const float dv = sqrtf((v[0]-s[0])*(v[0]-s[0]) + (v[1]-s[1])*(v[1]-s[1]) + (v[2]-s[2])*(v[2]-s[2]));
+			if (dv > s[3]) {
+				const float k = (dv - s[3]) * 0.5f / dv;
+				for (int c = 0; c < 3; c++)
+					s[c] += (v[c] - s[c]) * k;
+				s[3] = (s[3] + dv) * 0.5f;
+			}
+		}
+
+		// The cone axis is the average of the face normals, degenerate triangles are ignored
+		std::vector<float> normals;
+		float *axis = cluster.cone;
+		axis[0] = axis[1] = axis[2] = 0.f;
+		axis[3] = 1.f;
+		for (unsigned int i = 0; i + 2 < cluster.count; i += 3) {
+			const float *a = &vertices[indices[i]*vertexSize], *b = &vertices[indices[i+1]*vertexSize], *c = &vertices[indices[i+2]*vertexSize];
+			const float e1[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]}, e2[3] = {c[0]-a[0], c[1]-a[1], c[2]-a[2]};
+			float n[3] = {e1[1]*e2[2]-e1[2]*e2[1], e1[2]*e2[0]-e1[0]*e2[2], e1[0]*e2[1]-e1[1]*e2[0]};
+			const float len = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			if (len <= FLT_EPSILON)
+				continue;
+			for (int j = 0; j < 3; j++) {
+				n[j] /= len;
+				axis[j] += n[j];
+				normals.push_back(n[j]);
+			}
+		}
+		const float len = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+		if (len <= FLT_EPSILON || normals.empty())
+			return;
+		for (int j = 0; j < 3; j++)
+			axis[j] /= len;
+		float minDot = 1.f;
+		for (unsigned int i = 0; i < normals.size(); i += 3)
+			minDot = std::min(minDot, normals[i]*axis[0] + normals[i+1]*axis[1] + normals[i+2]*axis[2]);
+		// Like meshoptimizer, nearly hemispherical cones are disabled, the backface test is unreliable under float error there
+		if (minDot > 0.1f)
+			axis[3] = sqrtf(1.f - minDot * minDot);
+	}
+
+	/** The number of vertices of the triangle that are not yet marked with the stamp. */
+	template<class T> inline unsigned int countNewVertices(const std::vector<int> &stamps, const int &stamp, const T &a, const T &b, const T &c) {
+		return (stamps[a] != stamp ? 1 : 0) + (stamps[b] != stamp && b != a ? 1 : 0) + (stamps[c] != stamp && c != a && c != b ? 1 : 0);
+	}
+
+	/** Split the triangles in consecutive clusters of at most maxClusterVertexCount vertices and maxClusterTriangleCount triangles.
+	 * The triangles are not reordered, so spatially sorting them first results in tighter clusters. */
+	template<class T> void buildClusters(std::vector<modeldata::MeshPart::Cluster> &clusters, const std::vector<T> &indices, const float * const &vertices, const unsigned int &vertexSize, const unsigned int &vertexCount) {
+		clusters.clear();
+		std::vector<int> stamps(vertexCount, -1);
+		modeldata::MeshPart::Cluster cluster;
+		unsigned int clusterVertexCount = 0;
+		for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+			const T &a = indices[i], &b = indices[i+1], &c = indices[i+2];
+			unsigned int added = countNewVertices(stamps, (int)clusters.size(), a, b, c);
+			if (cluster.count > 0 && (clusterVertexCount + added > maxClusterVertexCount || cluster.count / 3 + 1 > maxClusterTriangleCount)) {
+				calculateClusterBounds(cluster, &indices[cluster.offset], vertices, vertexSize);
+				clusters.push_back(cluster);
+				cluster = modeldata::MeshPart::Cluster();
+				cluster.offset = i;
+				clusterVertexCount = 0;
+				added = countNewVertices(stamps, (int)clusters.size(), a, b, c);
+			}
+			stamps[a] = stamps[b] = stamps[c] = (int)clusters.size();
+			clusterVertexCount += added;
+			cluster.count += 3;
+		}
+		if (cluster.count > 0) {
+			calculateClusterBounds(cluster, &indices[cluster.offset], vertices, vertexSize);
+			clusters.push_back(cluster);
+		}
+	}
+} } }
+
+#endif //FBXCONV_READERS_MESHOPT_H
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif //_MSC_VER
+#ifndef FBXCONV_READERS_PNGWRITER_H
+#define FBXCONV_READERS_PNGWRITER_H
+
+#include <stdio.h>
+#include <png.h>
+
+namespace fbxconv {
+namespace readers {
+	/** Write the RGBA pixels (8 or 16 bits per channel, 16 bit channels in native byte order) to a PNG file, returns false on failure. */
+	inline bool writePNG(const char * const &filename, const unsigned int &width, const unsigned int &height, const int &bitDepth, const void * const &pixels) {
+		FILE *file = fopen(filename, "wb");
+		if (!file)
+			return false;
+		png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+		png_infop info = png ? png_create_info_struct(png) : 0;
+		if (!info || setjmp(png_jmpbuf(png))) {
+			png_destroy_write_struct(&png, info ? &info : 0);
+			fclose(file);
+			return false;
+		}
+		png_init_io(png, file);
+		png_set_IHDR(png, info, width, height, bitDepth, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_write_info(png, info);
+		const unsigned short one = 1;
+		if (bitDepth == 16 && *(const unsigned char *)&one == 1)
+			png_set_swap(png);
+		const size_t stride = (size_t)width * 4 * (bitDepth / 8);
+		for (unsigned int y = 0; y < height; y++)
+			png_write_row(png, (png_bytep)pixels + y * stride);
+		png_write_end(png, 0);
+		png_destroy_write_struct(&png, &info);
+		fclose(file);
+		return true;
+	}
+} }
+
+#endif //FBXCONV_READERS_PNGWRITER_H
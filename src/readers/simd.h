@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * Copyright 2011 See AUTHORS file.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+/** @author Xoppa */
+#ifdef _MSC_VER
+#pragma once
+#endif //_MSC_VER
+#ifndef FBXCONV_READERS_SIMD_H
+#define FBXCONV_READERS_SIMD_H
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "matrix3.h"
+
+#if defined(__AVX2__)
+#define FBXCONV_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FBXCONV_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define FBXCONV_NEON
+#include <arm_neon.h>
+#endif
+
+namespace fbxconv {
+namespace readers {
+namespace simd {
+	// Batch kernels working on whole (FBX) attribute arrays, each with a scalar fallback.
+
+	inline float clamp01(const float &v) {
+		return v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+	}
+
+	/** Negate the quaternion q if it's not in the same hemisphere as the quaternion p, so they interpolate along the shortest path. */
+	inline void alignQuaternion(const float * const &p, float * const &q) {
+		if (p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3] < 0.f)
+			for (int j = 0; j < 4; j++)
+				q[j] = -q[j];
+	}
+
+	/** Convert count double uv pairs to float and transform them by the matrix (x' = x1*u + x2*v + x3, y' = y1*u + y2*v + y3). */
+	inline void transformUVs(const Matrix3<float> &m, const double * const &src, float * const &dst, const unsigned int &count) {
+		unsigned int i = 0;
+#if defined(FBXCONV_AVX2)
+		{
+			const __m256 a = _mm256_setr_ps(m.x1, m.y1, m.x1, m.y1, m.x1, m.y1, m.x1, m.y1);
+			const __m256 b = _mm256_setr_ps(m.x2, m.y2, m.x2, m.y2, m.x2, m.y2, m.x2, m.y2);
+			const __m256 c = _mm256_setr_ps(m.x3, m.y3, m.x3, m.y3, m.x3, m.y3, m.x3, m.y3);
+			for (; i + 4 <= count; i += 4) {
+				const __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(&src[i * 2]));
+				const __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(&src[i * 2 + 4]));
+				const __m256 uv = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+				const __m256 uu = _mm256_shuffle_ps(uv, uv, _MM_SHUFFLE(2, 2, 0, 0));
+				const __m256 vv = _mm256_shuffle_ps(uv, uv, _MM_SHUFFLE(3, 3, 1, 1));
+				_mm256_storeu_ps(&dst[i * 2], _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, uu), _mm256_mul_ps(b, vv)), c));
+			}
+		}
+#endif
+#if defined(FBXCONV_SSE2)
+		{
+			const __m128 a = _mm_setr_ps(m.x1, m.y1, m.x1, m.y1);
+			const __m128 b = _mm_setr_ps(m.x2, m.y2, m.x2, m.y2);
+			const __m128 c = _mm_setr_ps(m.x3, m.y3, m.x3, m.y3);
+			for (; i + 2 <= count; i += 2) {
+				const __m128 uv = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(&src[i * 2])), _mm_cvtpd_ps(_mm_loadu_pd(&src[i * 2 + 2])));
+				const __m128 uu = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(2, 2, 0, 0));
+				const __m128 vv = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(3, 3, 1, 1));
+				_mm_storeu_ps(&dst[i * 2], _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, uu), _mm_mul_ps(b, vv)), c));
+			}
+		}
+#elif defined(FBXCONV_NEON)
+		{
+			const float ca[4] = {m.x1, m.y1, m.x1, m.y1}, cb[4] = {m.x2, m.y2, m.x2, m.y2}, cc[4] = {m.x3, m.y3, m.x3, m.y3};
+			const float32x4_t a = vld1q_f32(ca), b = vld1q_f32(cb), c = vld1q_f32(cc);
+			for (; i + 2 <= count; i += 2) {
+				const float32x4_t uv = vcombine_f32(vcvt_f32_f64(vld1q_f64(&src[i * 2])), vcvt_f32_f64(vld1q_f64(&src[i * 2 + 2])));
+				const float32x4_t uu = vtrn1q_f32(uv, uv);
+				const float32x4_t vv = vtrn2q_f32(uv, uv);
+				vst1q_f32(&dst[i * 2], vmlaq_f32(vmlaq_f32(c, a, uu), b, vv));
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			dst[i * 2] = (float)src[i * 2];
+			dst[i * 2 + 1] = (float)src[i * 2 + 1];
+			m.transform(dst[i * 2], dst[i * 2 + 1]);
+		}
+	}
+
+	/** Pack count double rgba colors (clamped to [0, 1]) into one unsigned int each, red in the lowest byte and alpha in the highest. */
+	inline void packColors(const double * const &src, unsigned int * const &dst, const unsigned int &count) {
+		unsigned int i = 0;
+#if defined(FBXCONV_SSE2)
+		{
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), scale = _mm_set1_ps(255.f);
+			__m128i c[4];
+			for (; i + 4 <= count; i += 4) {
+				for (int j = 0; j < 4; j++) {
+					const double * const s = &src[(i + j) * 4];
+					const __m128 rgba = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(s)), _mm_cvtpd_ps(_mm_loadu_pd(s + 2)));
+					c[j] = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(rgba, zero), one), scale));
+				}
+				_mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(_mm_packs_epi32(c[0], c[1]), _mm_packs_epi32(c[2], c[3])));
+			}
+		}
+#elif defined(FBXCONV_NEON)
+		{
+			const float32x4_t zero = vdupq_n_f32(0.f), one = vdupq_n_f32(1.f), scale = vdupq_n_f32(255.f);
+			for (; i + 2 <= count; i += 2) {
+				const double * const s = &src[i * 4];
+				const float32x4_t c0 = vcombine_f32(vcvt_f32_f64(vld1q_f64(s)), vcvt_f32_f64(vld1q_f64(s + 2)));
+				const float32x4_t c1 = vcombine_f32(vcvt_f32_f64(vld1q_f64(s + 4)), vcvt_f32_f64(vld1q_f64(s + 6)));
+				const uint16x4_t p0 = vmovn_u32(vcvtq_u32_f32(vmulq_f32(vminq_f32(vmaxq_f32(c0, zero), one), scale)));
+				const uint16x4_t p1 = vmovn_u32(vcvtq_u32_f32(vmulq_f32(vminq_f32(vmaxq_f32(c1, zero), one), scale)));
+				vst1_u8((uint8_t *)&dst[i], vmovn_u16(vcombine_u16(p0, p1)));
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			const double * const s = &src[i * 4];
+			dst[i] = ((unsigned int)(255.f * clamp01((float)s[3])) << 24) | ((unsigned int)(255.f * clamp01((float)s[2])) << 16) |
+				((unsigned int)(255.f * clamp01((float)s[1])) << 8) | ((unsigned int)(255.f * clamp01((float)s[0])));
+		}
+	}
+
+#if defined(FBXCONV_SSE2)
+	/** Per lane: a where the mask is set, b otherwise. */
+	inline __m128 select(const __m128 &mask, const __m128 &a, const __m128 &b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+#endif
+
+	/** Decompose count affine 4x4 matrices (16 doubles each, row major with the translation in the last row, like FbxAMatrix)
+	 * into translation, rotation quaternion (x, y, z, w) and scale. Consecutive quaternions are kept in the same hemisphere.
+	 * The output of consecutive matrices is stride floats apart, e.g. 3, 4 and 3 for separate arrays or the size of a struct. */
+	inline void decomposeTransforms(const double * const &src, float * const &translation, float * const &rotation, float * const &scale, const unsigned int &stride, const unsigned int &count) {
+		unsigned int i = 0;
+#if defined(FBXCONV_SSE2)
+		{
+			const __m128 one = _mm_set1_ps(1.f), eps = _mm_set1_ps(1e-20f);
+			const __m128 signMask = _mm_set1_ps(-0.f);
+			__m128 m[9];
+			float q[4][4], s[3][4];
+			for (; i + 4 <= count; i += 4) {
+				// Gather the upper 3x3 of four matrices, one element per register
+				for (int j = 0; j < 9; j++) {
+					const int e = (j / 3) * 4 + (j % 3);
+					m[j] = _mm_setr_ps((float)src[i * 16 + e], (float)src[(i + 1) * 16 + e], (float)src[(i + 2) * 16 + e], (float)src[(i + 3) * 16 + e]);
+				}
+				// The scale is the length of each row, negated if the matrix mirrors
+				const __m128 det = _mm_add_ps(_mm_sub_ps(
+					_mm_mul_ps(m[0], _mm_sub_ps(_mm_mul_ps(m[4], m[8]), _mm_mul_ps(m[5], m[7]))),
+					_mm_mul_ps(m[1], _mm_sub_ps(_mm_mul_ps(m[3], m[8]), _mm_mul_ps(m[5], m[6])))),
+					_mm_mul_ps(m[2], _mm_sub_ps(_mm_mul_ps(m[3], m[7]), _mm_mul_ps(m[4], m[6]))));
+				const __m128 detSign = _mm_and_ps(det, signMask);
+				__m128 r[9];
+				for (int j = 0; j < 3; j++) {
+					const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[j*3], m[j*3]), _mm_mul_ps(m[j*3+1], m[j*3+1])), _mm_mul_ps(m[j*3+2], m[j*3+2])));
+					const __m128 sc = _mm_xor_ps(len, detSign);
+					const __m128 inv = _mm_div_ps(one, _mm_xor_ps(_mm_max_ps(len, eps), detSign));
+					_mm_storeu_ps(s[j], sc);
+					for (int k = 0; k < 3; k++)
+						r[j*3+k] = _mm_mul_ps(m[j*3+k], inv);
+				}
+				// Matrix to quaternion (Shepperd): start from the largest of w, x, y and z (the largest t), which is calculated
+				// from the diagonal, the others are calculated from the off diagonal elements. Selected per lane using masks.
+				const __m128 d05 = _mm_sub_ps(r[5], r[7]), d62 = _mm_sub_ps(r[6], r[2]), d13 = _mm_sub_ps(r[1], r[3]);
+				const __m128 s13 = _mm_add_ps(r[1], r[3]), s26 = _mm_add_ps(r[2], r[6]), s57 = _mm_add_ps(r[5], r[7]);
+				__m128 t = _mm_add_ps(one, _mm_add_ps(_mm_add_ps(r[0], r[4]), r[8]));
+				__m128 qw = t, qx = d05, qy = d62, qz = d13;
+				const __m128 tx = _mm_add_ps(one, _mm_sub_ps(_mm_sub_ps(r[0], r[4]), r[8]));
+				__m128 mask = _mm_cmpgt_ps(tx, t);
+				t = select(mask, tx, t);
+				qw = select(mask, d05, qw); qx = select(mask, tx, qx); qy = select(mask, s13, qy); qz = select(mask, s26, qz);
+				const __m128 ty = _mm_add_ps(one, _mm_sub_ps(_mm_sub_ps(r[4], r[0]), r[8]));
+				mask = _mm_cmpgt_ps(ty, t);
+				t = select(mask, ty, t);
+				qw = select(mask, d62, qw); qx = select(mask, s13, qx); qy = select(mask, ty, qy); qz = select(mask, s57, qz);
+				const __m128 tz = _mm_add_ps(one, _mm_sub_ps(_mm_sub_ps(r[8], r[0]), r[4]));
+				mask = _mm_cmpgt_ps(tz, t);
+				qw = select(mask, d13, qw); qx = select(mask, s26, qx); qy = select(mask, s57, qy); qz = select(mask, tz, qz);
+				const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw))));
+				const __m128 inv = _mm_div_ps(one, _mm_max_ps(len, eps));
+				_mm_storeu_ps(q[0], _mm_mul_ps(qx, inv));
+				_mm_storeu_ps(q[1], _mm_mul_ps(qy, inv));
+				_mm_storeu_ps(q[2], _mm_mul_ps(qz, inv));
+				_mm_storeu_ps(q[3], _mm_mul_ps(qw, inv));
+				for (unsigned int j = 0; j < 4; j++) {
+					const unsigned int o = (i + j) * stride;
+					for (int k = 0; k < 3; k++) {
+						translation[o + k] = (float)src[(i + j) * 16 + 12 + k];
+						scale[o + k] = s[k][j];
+					}
+					for (int k = 0; k < 4; k++)
+						rotation[o + k] = q[k][j];
+					if (i + j > 0)
+						alignQuaternion(&rotation[o - stride], &rotation[o]);
+				}
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			const double * const m = &src[i * 16];
+			const unsigned int o = i * stride;
+			const double det = m[0] * (m[5] * m[10] - m[6] * m[9]) - m[1] * (m[4] * m[10] - m[6] * m[8]) + m[2] * (m[4] * m[9] - m[5] * m[8]);
+			double r[9];
+			for (int j = 0; j < 3; j++) {
+				const double len = sqrt(m[j*4] * m[j*4] + m[j*4+1] * m[j*4+1] + m[j*4+2] * m[j*4+2]);
+				const double sc = det < 0. ? -len : len;
+				scale[o + j] = (float)sc;
+				translation[o + j] = (float)m[12 + j];
+				for (int k = 0; k < 3; k++)
+					r[j*3+k] = m[j*4+k] / (len > 1e-20 ? sc : 1e-20);
+			}
+			// Matrix to quaternion (Shepperd): start from the largest of w, x, y and z, the others follow from the off diagonal elements
+			const double t[4] = { 1. + r[0] - r[4] - r[8], 1. - r[0] + r[4] - r[8], 1. - r[0] - r[4] + r[8], 1. + r[0] + r[4] + r[8] };
+			const int largest = (int)(std::max_element(t, t + 4) - t);
+			double q[4];
+			if (largest == 0) {
+				q[0] = t[0]; q[1] = r[1] + r[3]; q[2] = r[2] + r[6]; q[3] = r[5] - r[7];
+			}
+			else if (largest == 1) {
+				q[0] = r[1] + r[3]; q[1] = t[1]; q[2] = r[5] + r[7]; q[3] = r[6] - r[2];
+			}
+			else if (largest == 2) {
+				q[0] = r[2] + r[6]; q[1] = r[5] + r[7]; q[2] = t[2]; q[3] = r[1] - r[3];
+			}
+			else {
+				q[0] = r[5] - r[7]; q[1] = r[6] - r[2]; q[2] = r[1] - r[3]; q[3] = t[3];
+			}
+			const double len = std::max(sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]), 1e-20);
+			for (int k = 0; k < 4; k++)
+				rotation[o + k] = (float)(q[k] / len);
+			if (i > 0)
+				alignQuaternion(&rotation[o - stride], &rotation[o]);
+		}
+	}
+
+	/** Reinterpret the bits of a packed color as a float, without breaking strict aliasing. */
+	inline float packedColorToFloat(const unsigned int &packed) {
+		float result;
+		memcpy(&result, &packed, sizeof(float));
+		return result;
+	}
+} } }
+
+#endif //FBXCONV_READERS_SIMD_H
@@ -21,8 +21,11 @@
 #define FBXCONV_READERS_UTIL_H
 
 #include <vector>
+#include <string>
 #include <algorithm>
+#include <ctype.h>
 #include <assert.h>
+#include <math.h>
 
 namespace fbxconv {
 namespace readers {
@@ -164,8 +167,114 @@ namespace readers {
 			for (std::vector<BlendBones>::iterator itr = bones.begin(); itr != bones.end(); ++itr)
 				(*itr).sort();
 		}
+		/** Partition the bone sets (sorted, unique) in as few groups as possible, instead of greedily in the order of the sets.
+		 * Each group starts with the largest remaining set, after which it's filled with the sets adding the least new bones
+		 * (most bones in common, then most polygons) until none fits anymore. The weight is the amount of polygons using the
+		 * set. Sets which don't fit a group on their own are left unassigned (-1). Returns the group of each set. */
+		inline void partition(const std::vector<std::vector<int> > &sets, const std::vector<unsigned int> &weights, std::vector<int> &result) {
+			result.assign(sets.size(), -1);
+			std::vector<unsigned int> order(sets.size());
+			for (unsigned int i = 0; i < order.size(); i++)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), SetOrder(sets, weights));
+			for (std::vector<unsigned int>::const_iterator itr = order.begin(); itr != order.end(); ++itr) {
+				if (result[*itr] >= 0 || sets[*itr].size() > bonesCapacity)
+					continue;
+				const int idx = (int)bones.size();
+				bones.push_back(BlendBones(bonesCapacity));
+				BlendBones &group = bones.back();
+				add(group, sets[*itr]);
+				result[*itr] = idx;
+				for (;;) {
+					// Sets which are already covered are added right away, only the best of the others is added per pass
+					int best = -1, bestCost = 0, bestShared = 0;
+					for (std::vector<unsigned int>::const_iterator jtr = itr + 1; jtr != order.end(); ++jtr) {
+						if (result[*jtr] >= 0)
+							continue;
+						const std::vector<int> &set = sets[*jtr];
+						int cost = 0;
+						for (std::vector<int>::const_iterator b = set.begin(); b != set.end(); ++b)
+							if (!group.has(*b))
+								cost++;
+						if (cost == 0)
+							result[*jtr] = idx;
+						else if (cost <= (int)group.available()) {
+							const int shared = (int)set.size() - cost;
+							if (best < 0 || cost < bestCost || (cost == bestCost && (shared > bestShared || (shared == bestShared && weights[*jtr] > weights[best])))) {
+								best = (int)*jtr;
+								bestCost = cost;
+								bestShared = shared;
+							}
+						}
+					}
+					if (best < 0)
+						break;
+					add(group, sets[best]);
+					result[best] = idx;
+				}
+			}
+		}
+	private:
+		struct SetOrder {
+			const std::vector<std::vector<int> > &sets;
+			const std::vector<unsigned int> &weights;
+			SetOrder(const std::vector<std::vector<int> > &sets, const std::vector<unsigned int> &weights) : sets(sets), weights(weights) {}
+			inline bool operator()(const unsigned int &a, const unsigned int &b) const {
+				return sets[a].size() != sets[b].size() ? sets[a].size() > sets[b].size() : (weights[a] != weights[b] ? weights[a] > weights[b] : a < b);
+			}
+		};
+		inline static void add(BlendBones &group, const std::vector<int> &set) {
+			for (std::vector<int>::const_iterator itr = set.begin(); itr != set.end(); ++itr)
+				group.add(*itr);
+		}
 	};
 
+	// Spherical interpolation of two quaternions (x, y, z, w) along the shortest path
+	inline void slerp(float * const &out, const float *q1, const float *q2, const float &alpha) {
+		float d = q1[0]*q2[0] + q1[1]*q2[1] + q1[2]*q2[2] + q1[3]*q2[3];
+		const float sign = d < 0.f ? -1.f : 1.f;
+		d *= sign;
+		float s1 = 1.f - alpha, s2 = alpha * sign;
+		if (d < 0.9999f) {
+			const float theta = acosf(d);
+			const float invSin = 1.f / sinf(theta);
+			s1 = sinf(s1 * theta) * invSin;
+			s2 = sinf(alpha * theta) * invSin * sign;
+		}
+		for (int i = 0; i < 4; i++)
+			out[i] = s1 * q1[i] + s2 * q2[i];
+	}
+
+	// The angle in degrees between two rotations (x, y, z, w)
+	inline float quaternionAngle(const float *q1, const float *q2) {
+		float d = q1[0]*q2[0] + q1[1]*q2[1] + q1[2]*q2[2] + q1[3]*q2[3];
+		d = std::min(1.f, d < 0.f ? -d : d);
+		return 2.f * acosf(d) * 57.2957795f;
+	}
+
+	// The id with the characters which aren't safe in a filename replaced
+	inline std::string getSafeFileName(const std::string &id) {
+		std::string result(id);
+		for (std::string::iterator itr = result.begin(); itr != result.end(); ++itr)
+			if (!isalnum((unsigned char)*itr) && *itr != '-' && *itr != '_')
+				*itr = '_';
+		return result;
+	}
+
+	// The directory of the file, including the trailing separator
+	inline std::string getDirectory(const std::string &path) {
+		const size_t index = path.find_last_of("/\\");
+		return index == std::string::npos ? std::string() : path.substr(0, index + 1);
+	}
+
+	// The filename without directory and extension
+	inline std::string getBaseName(const std::string &path) {
+		const size_t index = path.find_last_of("/\\");
+		const std::string result = index == std::string::npos ? path : path.substr(index + 1);
+		const size_t dot = result.find_last_of('.');
+		return dot == std::string::npos ? result : result.substr(0, dot);
+	}
+
 	// Provides information about an animation
 	struct AnimInfo {
 		float start;